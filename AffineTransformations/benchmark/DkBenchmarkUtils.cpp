@@ -0,0 +1,207 @@
+/*******************************************************************************************************
+ DkBenchmarkUtils.cpp
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#include "DkBenchmarkUtils.h"
+#include "../src/DkImageWarp.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#if defined(WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif !defined(Q_OS_LINUX)
+#include <sys/resource.h>
+#endif
+
+namespace nmp {
+
+namespace {
+
+/**
+* Simple linear congruential generator - the pages are the same on all platforms.
+**/
+inline int nextRand(unsigned int& seed, int range) {
+
+	seed = seed * 1103515245 + 12345;
+	return (int)((seed >> 16) % (unsigned int)qMax(range, 1));
+}
+
+void fillRect(QImage& img, int x, int y, int width, int height, int val) {
+
+	QRect r = QRect(x, y, width, height) & img.rect();
+
+	for (int row = r.top(); row <= r.bottom(); row++) {
+		QRgb* ptr = reinterpret_cast<QRgb*>(img.scanLine(row));
+		for (int col = r.left(); col <= r.right(); col++)
+			ptr[col] = qRgb(val, val, val);
+	}
+}
+
+#ifdef Q_OS_LINUX
+qint64 procStatus(const QString& key) {
+
+	QFile file("/proc/self/status");
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+		return 0;
+
+	QTextStream stream(&file);
+	for (QString line = stream.readLine(); !line.isNull(); line = stream.readLine()) {
+
+		if (line.startsWith(key))
+			return line.mid(key.size()).trimmed().split(' ').first().toLongLong() * 1024;	// kB
+	}
+
+	return 0;
+}
+#endif
+
+};
+
+/**
+* Creates a text page: lines of words whose characters are dark strokes.
+* Paragraphs, margins and noise are random.
+**/
+QImage DkBenchmarkUtils::createPage(int width, int height, unsigned int seed) {
+
+	QImage img(width, height, QImage::Format_RGB32);
+	img.fill(qRgb(240, 240, 240));
+
+	int margin = width / 10;
+	int lineHeight = qMax(height / 55, 6);
+	int textHeight = qMax(lineHeight / 2, 3);
+	int charWidth = qMax(textHeight * 2 / 3, 2);
+	int strokeWidth = qMax(charWidth / 3, 1);
+
+	for (int y = margin; y + lineHeight < height - margin; y += lineHeight) {
+
+		// paragraph break
+		if (nextRand(seed, 12) == 0)
+			continue;
+
+		int x = margin + (nextRand(seed, 8) == 0 ? 4 * charWidth : 0);
+		int lineEnd = width - margin - (nextRand(seed, 10) == 0 ? nextRand(seed, width / 2) : 0);
+
+		while (x < lineEnd) {
+
+			int nChars = 1 + nextRand(seed, 10);
+			if (x + nChars * charWidth > lineEnd)
+				break;
+
+			for (int idx = 0; idx < nChars; idx++) {
+
+				// ascenders and descenders
+				int top = y + (nextRand(seed, 5) == 0 ? -textHeight / 2 : 0);
+				int bottom = y + textHeight + (nextRand(seed, 7) == 0 ? textHeight / 2 : 0);
+				int cx = x + idx * charWidth;
+
+				fillRect(img, cx, top, strokeWidth, bottom - top, 30);
+				fillRect(img, cx, y, charWidth - strokeWidth, strokeWidth, 30);
+				fillRect(img, cx, y + textHeight - strokeWidth, charWidth - strokeWidth, strokeWidth, 30);
+			}
+
+			x += (nChars + 1) * charWidth;
+		}
+	}
+
+	// noise
+	for (int row = 0; row < img.height(); row++) {
+		QRgb* ptr = reinterpret_cast<QRgb*>(img.scanLine(row));
+		for (int col = 0; col < img.width(); col++) {
+			int val = qBound(0, qRed(ptr[col]) + nextRand(seed, 21) - 10, 255);
+			ptr[col] = qRgb(val, val, val);
+		}
+	}
+
+	return img;
+}
+
+/**
+* Rotates the page by angle (in degree, clockwise) around its center.
+* The size is kept, corners are filled with white.
+**/
+QImage DkBenchmarkUtils::rotatePage(const QImage& page, double angle) {
+
+	QTransform t;
+	t.translate(0.5 * page.width(), 0.5 * page.height());
+	t.rotate(angle);
+	t.translate(-0.5 * page.width(), -0.5 * page.height());
+
+	DkImageWarp warp(page);
+	warp.setInterpolation(DkImageWarp::interp_linear);
+	warp.setBackground(Qt::white);
+
+	return warp.warp(t, page.size());
+}
+
+qint64 DkBenchmarkUtils::currentMemory() {
+
+#if defined(WIN32)
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return (qint64)pmc.WorkingSetSize;
+	return 0;
+#elif defined(Q_OS_LINUX)
+	return procStatus("VmRSS:");
+#else
+	return 0;
+#endif
+}
+
+/**
+* Returns the peak resident memory since the last reset.
+* Only Linux can reset the peak - other platforms report the peak of the process.
+**/
+qint64 DkBenchmarkUtils::peakMemory() {
+
+#if defined(WIN32)
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return (qint64)pmc.PeakWorkingSetSize;
+	return 0;
+#elif defined(Q_OS_LINUX)
+	return procStatus("VmHWM:");
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return (qint64)usage.ru_maxrss;	// bytes on macOS
+	return 0;
+#endif
+}
+
+void DkBenchmarkUtils::resetPeakMemory() {
+
+#ifdef Q_OS_LINUX
+	// resets VmHWM to the current resident size
+	QFile file("/proc/self/clear_refs");
+	if (file.open(QIODevice::WriteOnly))
+		file.write("5");
+#endif
+}
+
+};
@@ -0,0 +1,50 @@
+/*******************************************************************************************************
+ DkBenchmarkUtils.h
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#pragma once
+
+#include <QImage>
+
+namespace nmp {
+
+/**
+*	Helpers of the affine transformations benchmarks.
+*	Pages are synthetic so that no test data is needed.
+**/
+namespace DkBenchmarkUtils {
+
+	QImage createPage(int width, int height, unsigned int seed = 42);
+	QImage rotatePage(const QImage& page, double angle);
+
+	// resident memory of the process in bytes (0 if unknown)
+	qint64 currentMemory();
+	qint64 peakMemory();
+	void resetPeakMemory();
+};
+
+};
@@ -0,0 +1,101 @@
+/*******************************************************************************************************
+ DkDeskewBenchmark.cpp
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#include "../src/DkSkewEstimator.h"
+#include "DkBenchmarkUtils.h"
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QVector>
+#include <QStringList>
+
+#include <cstdio>
+
+using namespace nmp;
+
+/**
+* Estimates the skew of synthetic pages that are rotated by known angles.
+* Each page is measured at several resolutions with both search modes.
+* The results (wall time, peak memory, angular error) are printed as CSV.
+* usage: deskewBenchmark [max width]
+**/
+int main(int argc, char** argv) {
+
+	int maxWidth = (argc > 1) ? QString(argv[1]).toInt() : 0;
+
+	// A4 at 150, 300 and 600 dpi
+	QVector<QSize> sizes;
+	sizes << QSize(1240, 1754) << QSize(2480, 3508) << QSize(4961, 7016);
+
+	QVector<double> angles;
+	angles << -7.3 << -2.6 << -0.85 << 0.0 << 0.35 << 1.2 << 4.75;
+
+	QStringList modeNames;
+	modeNames << "full" << "pyramid";
+
+	printf("width;height;mode;angle;estimate;error;time [ms];peak memory [MB]\n");
+
+	for (int sIdx = 0; sIdx < sizes.size(); sIdx++) {
+
+		if (maxWidth > 0 && sizes[sIdx].width() > maxWidth)
+			continue;
+
+		QImage page = DkBenchmarkUtils::createPage(sizes[sIdx].width(), sizes[sIdx].height());
+
+		for (int aIdx = 0; aIdx < angles.size(); aIdx++) {
+
+			QImage img = DkBenchmarkUtils::rotatePage(page, angles[aIdx]);
+
+			for (int mode = 0; mode < DkSkewEstimator::search_end; mode++) {
+
+				DkBenchmarkUtils::resetPeakMemory();
+				qint64 memBefore = DkBenchmarkUtils::currentMemory();
+
+				QElapsedTimer dt;
+				dt.start();
+
+				DkSkewEstimator estimator;
+				estimator.setSearchMode(mode);
+				estimator.setImage(img);
+				double estimate = estimator.getSkewAngle();
+
+				qint64 time = dt.elapsed();
+				double peak = qMax(DkBenchmarkUtils::peakMemory() - memBefore, (qint64)0) / (1024.0 * 1024.0);
+
+				// the estimated angle rotates the page back
+				double error = qAbs(estimate + angles[aIdx]);
+
+				printf("%d;%d;%s;%.2f;%.2f;%.3f;%lld;%.1f\n", img.width(), img.height(), qPrintable(modeNames[mode]),
+					angles[aIdx], estimate, error, (long long)time, peak);
+				fflush(stdout);
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*******************************************************************************************************
+ DkSeparabilityBenchmark.cpp
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "../src/DkSkewEstimator.h"
+#include "DkBenchmarkUtils.h"
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QVector>
+
+#include <cstdio>
+#include <cmath>
+
+using namespace nmp;
+
+/**
+* The original separability with double integrals accessed pixel by pixel.
+**/
+cv::Mat referenceSeparability(const QImage& img, int direction) {
+
+	cv::Mat gray(img.height(), img.width(), CV_8UC1);
+	for (int r = 0; r < img.height(); r++) {
+		const QRgb* ptr = reinterpret_cast<const QRgb*>(img.constScanLine(r));
+		unsigned char* gPtr = gray.ptr<unsigned char>(r);
+		for (int c = 0; c < img.width(); c++)
+			gPtr[c] = (unsigned char)qRed(ptr[c]);
+	}
+
+	// same as DkSkewEstimator::setImage
+	QSize sepDims(qRound(img.width()/1430.0*49.0), qRound(img.height()/700.0*12.0));
+	int delta = qRound(img.width()/1430.0*20.0);
+
+	if (img.width() < img.height()) {
+		gray = gray.t();
+		delta = qRound(img.height()/1430.0*20.0);
+	}
+
+	cv::Mat integral, integralSq;
+	cv::integral(gray, integral, integralSq, CV_64F);
+
+	cv::Mat separability = cv::Mat::zeros(integral.rows, integral.cols, CV_32FC1);
+
+	int W2 = qCeil(sepDims.width()/2);
+	int H2 = qCeil(sepDims.height()/2);
+	double area = 2.0 * W2 * H2;
+
+	int rowBorder = (direction == DkSkewEstimator::dir_horizontal ? H2 : W2) + delta/2;
+	int colBorder = (direction == DkSkewEstimator::dir_horizontal ? W2 : H2) + delta/2;
+
+	for (int r = rowBorder; r < integral.rows - rowBorder; r++) {
+		for (int c = colBorder; c < integral.cols - colBorder; c++) {
+
+			double s1, s2, q1, q2;
+
+			if (direction == DkSkewEstimator::dir_horizontal) {
+				s1 = integral.at<double>(r - H2, c - W2) + integral.at<double>(r - 1, c + W2) - integral.at<double>(r - H2, c + W2) - integral.at<double>(r - 1, c - W2);
+				s2 = integral.at<double>(r + 1, c - W2) + integral.at<double>(r + H2, c + W2) - integral.at<double>(r + 1, c + W2) - integral.at<double>(r + H2, c - W2);
+				q1 = integralSq.at<double>(r - H2, c - W2) + integralSq.at<double>(r - 1, c + W2) - integralSq.at<double>(r - H2, c + W2) - integralSq.at<double>(r - 1, c - W2);
+				q2 = integralSq.at<double>(r + 1, c - W2) + integralSq.at<double>(r + H2, c + W2) - integralSq.at<double>(r + 1, c + W2) - integralSq.at<double>(r + H2, c - W2);
+			}
+			else {
+				s1 = integral.at<double>(r - W2, c - H2) + integral.at<double>(r + W2, c - 1) - integral.at<double>(r + W2, c - H2) - integral.at<double>(r - W2, c - 1);
+				s2 = integral.at<double>(r - W2, c + 1) + integral.at<double>(r + W2, c + H2) - integral.at<double>(r + W2, c + 1) - integral.at<double>(r - W2, c + H2);
+				q1 = integralSq.at<double>(r - W2, c - H2) + integralSq.at<double>(r + W2, c - 1) - integralSq.at<double>(r + W2, c - H2) - integralSq.at<double>(r - W2, c - 1);
+				q2 = integralSq.at<double>(r - W2, c + 1) + integralSq.at<double>(r + W2, c + H2) - integralSq.at<double>(r + W2, c + 1) - integralSq.at<double>(r - W2, c + H2);
+			}
+
+			double mean1 = s1 / area;
+			double mean2 = s2 / area;
+			double var1 = q1 / area - mean1 * mean1;
+			double var2 = q2 / area - mean2 * mean2;
+
+			separability.at<float>(r, c) = (float)((mean1 - mean2) * (mean1 - mean2) / (var1 + var2));
+		}
+	}
+
+	return separability;
+}
+
+/**
+* Returns the largest relative error of sep compared to ref (NaN has to match NaN).
+**/
+double maxError(const cv::Mat& ref, const cv::Mat& sep) {
+
+	if (ref.size() != sep.size())
+		return HUGE_VAL;
+
+	double refMax = 0;
+	for (int r = 0; r < ref.rows; r++) {
+		const float* rPtr = ref.ptr<float>(r);
+		for (int c = 0; c < ref.cols; c++) {
+			if (std::isfinite(rPtr[c]))
+				refMax = qMax(refMax, (double)std::fabs(rPtr[c]));
+		}
+	}
+
+	double err = 0;
+	for (int r = 0; r < ref.rows; r++) {
+		const float* rPtr = ref.ptr<float>(r);
+		const float* sPtr = sep.ptr<float>(r);
+
+		for (int c = 0; c < ref.cols; c++) {
+
+			if (std::isnan(rPtr[c]) || std::isnan(sPtr[c])) {
+				if (std::isnan(rPtr[c]) != std::isnan(sPtr[c]))
+					return HUGE_VAL;
+				continue;
+			}
+
+			double d = std::fabs(rPtr[c] - sPtr[c]) / qMax((double)std::fabs(rPtr[c]), 1e-6 * refMax);
+			err = qMax(err, d);
+		}
+	}
+
+	return err;
+}
+
+/**
+* Compares DkSkewEstimator::separability against the reference implementation
+* for both integral modes and prints the timings.
+**/
+int main(int, char**) {
+
+	const double tolerance = 1e-4;
+	const int nRuns = 3;
+
+	QVector<QSize> sizes;
+	sizes << QSize(1430, 700) << QSize(2480, 3508) << QSize(4961, 7016);
+
+	bool ok = true;
+
+	printf("width;height;direction;reference [ms];double [ms];compact [ms];double error;compact error\n");
+
+	for (int sIdx = 0; sIdx < sizes.size(); sIdx++) {
+
+		QImage img = DkBenchmarkUtils::createPage(sizes[sIdx].width(), sizes[sIdx].height());
+
+		DkSkewEstimator estimator;
+		estimator.setImage(img);
+
+		for (int dir = 0; dir < DkSkewEstimator::dir_end; dir++) {
+
+			QElapsedTimer dt;
+			dt.start();
+			cv::Mat ref;
+			for (int idx = 0; idx < nRuns; idx++)
+				ref = referenceSeparability(img, dir);
+			double refTime = dt.elapsed() / (double)nRuns;
+
+			double modeTime[DkSkewEstimator::integral_end];
+			double modeError[DkSkewEstimator::integral_end];
+
+			for (int mode = 0; mode < DkSkewEstimator::integral_end; mode++) {
+
+				estimator.setIntegralMode(mode);
+
+				dt.restart();
+				cv::Mat sep;
+				for (int idx = 0; idx < nRuns; idx++)
+					sep = estimator.separability(dir);
+				modeTime[mode] = dt.elapsed() / (double)nRuns;
+				modeError[mode] = maxError(ref, sep);
+
+				if (modeError[mode] > tolerance)
+					ok = false;
+			}
+
+			printf("%d;%d;%d;%.1f;%.1f;%.1f;%g;%g\n", img.width(), img.height(), dir, refTime,
+				modeTime[DkSkewEstimator::integral_double], modeTime[DkSkewEstimator::integral_compact],
+				modeError[DkSkewEstimator::integral_double], modeError[DkSkewEstimator::integral_compact]);
+		}
+	}
+
+	if (!ok)
+		printf("the separability differs from the reference by more than %g\n", tolerance);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,590 @@
+/*******************************************************************************************************
+ DkImageWarp.cpp
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkImageWarp.h"
+#include "DkTransformUtils.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QVector>
+#include <QtConcurrentMap>
+#include <QtCore/qmath.h>
+#pragma warning(pop)		// no warnings from includes - end
+
+#include <cmath>
+
+namespace nmp {
+
+namespace {
+
+// source coordinates are stepped with 32 fractional bits - the error stays far below 1/256 pixel for any image width
+const int fixedShift = 32;
+const double fixedOne = 4294967296.0;
+
+// kernel weights are tabulated for 1/256 pixel steps
+const int lutBits = 8;
+const int lutSize = 1 << lutBits;
+
+const int maxTaps = 6;
+
+const double pi = 3.14159265358979323846;
+
+inline qint64 toFixed(double val) {
+	return qRound64(val * fixedOne);
+}
+
+inline int fixedFloor(qint64 val) {
+	return (int)(val >> fixedShift);
+}
+
+inline int fixedFrac(qint64 val) {
+	return (int)(val >> (fixedShift - lutBits)) & (lutSize - 1);
+}
+
+/**
+* Parameters shared by all row bands.
+* The sampling coordinate is c = u - 0.5 + offset where u is the continuous source coordinate (pixel edges at integers).
+* A kernel reads the taps floor(c) + kMin ... floor(c) + kMax.
+**/
+struct WarpParams {
+	double m11, m12, m21, m22, dx, dy;	// target -> source
+	double gradU, gradV;				// source pixels per target pixel
+	double offset;						// 0.5 for nearest neighbor
+	int kMin, kMax;
+	QVector<float> lut;					// lutSize x taps weights for the bicubic and Lanczos kernels
+	QRgb bg;							// premultiplied
+};
+
+/**
+* Keys' cubic convolution kernel with a = -0.5 (Catmull-Rom).
+**/
+double cubicWeight(double x) {
+
+	const double a = -0.5;
+	x = qAbs(x);
+
+	if (x < 1)
+		return ((a + 2) * x - (a + 3)) * x * x + 1;
+	if (x < 2)
+		return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a;
+
+	return 0;
+}
+
+/**
+* Lanczos kernel with 3 lobes.
+**/
+double lanczosWeight(double x) {
+
+	x = qAbs(x);
+
+	if (x < 1e-8)
+		return 1;
+	if (x >= 3)
+		return 0;
+
+	double px = pi * x;
+	return 3 * qSin(px) * qSin(px / 3) / (px * px);
+}
+
+/**
+* Tabulates the normalized kernel weights for all fractional offsets.
+**/
+QVector<float> weightLut(int method, int kMin, int kMax) {
+
+	int nTaps = kMax - kMin + 1;
+	QVector<float> lut(lutSize * nTaps);
+
+	for (int fIdx = 0; fIdx < lutSize; fIdx++) {
+
+		double f = (double)fIdx / lutSize;
+		double w[maxTaps];
+		double sum = 0;
+
+		for (int tIdx = 0; tIdx < nTaps; tIdx++) {
+			double d = kMin + tIdx - f;
+			w[tIdx] = (method == DkImageWarp::interp_cubic) ? cubicWeight(d) : lanczosWeight(d);
+			sum += w[tIdx];
+		}
+
+		for (int tIdx = 0; tIdx < nTaps; tIdx++)
+			lut[fIdx * nTaps + tIdx] = (float)(w[tIdx] / sum);
+	}
+
+	return lut;
+}
+
+/**
+* Blends two premultiplied pixels: (x * a + y * (256 - a)) / 256.
+**/
+inline QRgb blendPixel(QRgb x, QRgb y, uint a) {
+
+	uint b = 256 - a;
+	uint t = (x & 0xff00ff) * a + (y & 0xff00ff) * b;
+	t = (t >> 8) & 0xff00ff;
+
+	x = ((x >> 8) & 0xff00ff) * a + ((y >> 8) & 0xff00ff) * b;
+	x &= 0xff00ff00;
+
+	return x | t;
+}
+
+/**
+* Bilinear interpolation of four premultiplied pixels with 8 bit weights.
+**/
+inline QRgb sampleLinear(QRgb p00, QRgb p01, QRgb p10, QRgb p11, int fx, int fy) {
+
+#ifdef DK_TRANSFORM_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i half = _mm_set1_epi16(128);
+
+	// [p00 p01] and [p10 p11] as 16 bit channels
+	__m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)p00), _mm_cvtsi32_si128((int)p01)), zero);
+	__m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)p10), _mm_cvtsi32_si128((int)p11)), zero);
+
+	// the sums are <= 255 * 256 + 128 so they fit into unsigned 16 bit
+	__m128i col = _mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16((short)(lutSize - fy))), _mm_mullo_epi16(bottom, _mm_set1_epi16((short)fy)));
+	col = _mm_srli_epi16(_mm_add_epi16(col, half), 8);
+
+	__m128i wx = _mm_set_epi16((short)fx, (short)fx, (short)fx, (short)fx, (short)(lutSize - fx), (short)(lutSize - fx), (short)(lutSize - fx), (short)(lutSize - fx));
+	col = _mm_mullo_epi16(col, wx);
+	col = _mm_add_epi16(col, _mm_srli_si128(col, 8));
+	col = _mm_srli_epi16(_mm_add_epi16(col, half), 8);
+
+	return (QRgb)_mm_cvtsi128_si32(_mm_packus_epi16(col, col));
+#else
+	QRgb left = blendPixel(p10, p00, fy);
+	QRgb right = blendPixel(p11, p01, fy);
+	return blendPixel(right, left, fx);
+#endif
+}
+
+/**
+* Separable interpolation of nTaps x nTaps premultiplied pixels.
+* rows holds the row pointers of the taps, xIdx their columns.
+**/
+inline QRgb sampleSeparable(const QRgb* const* rows, const int* xIdx, int nTaps, const float* wx, const float* wy) {
+
+#ifdef DK_TRANSFORM_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	__m128 acc = _mm_setzero_ps();
+
+	for (int ry = 0; ry < nTaps; ry++) {
+
+		const QRgb* row = rows[ry];
+		__m128 rowAcc = _mm_setzero_ps();
+
+		for (int rx = 0; rx < nTaps; rx++) {
+			__m128i px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)row[xIdx[rx]]), zero), zero);
+			rowAcc = _mm_add_ps(rowAcc, _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_set1_ps(wx[rx])));
+		}
+
+		acc = _mm_add_ps(acc, _mm_mul_ps(rowAcc, _mm_set1_ps(wy[ry])));
+	}
+
+	// negative lobes overshoot - clip to [0 255] and keep the colors <= alpha
+	acc = _mm_min_ps(_mm_max_ps(acc, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+	acc = _mm_min_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(3, 3, 3, 3)));
+
+	__m128i val = _mm_cvtps_epi32(acc);
+	val = _mm_packs_epi32(val, val);
+
+	return (QRgb)_mm_cvtsi128_si32(_mm_packus_epi16(val, val));
+#else
+	float acc[4] = {0, 0, 0, 0};
+
+	for (int ry = 0; ry < nTaps; ry++) {
+
+		const QRgb* row = rows[ry];
+		float rowAcc[4] = {0, 0, 0, 0};
+
+		for (int rx = 0; rx < nTaps; rx++) {
+			QRgb px = row[xIdx[rx]];
+			for (int c = 0; c < 4; c++)
+				rowAcc[c] += ((px >> (c * 8)) & 0xff) * wx[rx];
+		}
+
+		for (int c = 0; c < 4; c++)
+			acc[c] += rowAcc[c] * wy[ry];
+	}
+
+	float alpha = qBound(0.0f, acc[3], 255.0f);
+	QRgb val = (QRgb)qRound(alpha) << 24;
+
+	for (int c = 0; c < 3; c++)
+		val |= (QRgb)qRound(qBound(0.0f, acc[c], alpha)) << (c * 8);
+
+	return val;
+#endif
+}
+
+/**
+* Samples one pixel whose taps are all inside the source image.
+**/
+template <int method>
+inline QRgb sampleInside(const uchar* bits, int bpl, const WarpParams& p, qint64 fu, qint64 fv) {
+
+	int x0 = fixedFloor(fu);
+	int y0 = fixedFloor(fv);
+	const QRgb* row = (const QRgb*)(bits + (size_t)y0 * bpl);
+
+	if (method == DkImageWarp::interp_nearest)
+		return row[x0];
+
+	if (method == DkImageWarp::interp_linear) {
+		const QRgb* nextRow = (const QRgb*)((const uchar*)row + bpl);
+		return sampleLinear(row[x0], row[x0 + 1], nextRow[x0], nextRow[x0 + 1], fixedFrac(fu), fixedFrac(fv));
+	}
+
+	int nTaps = p.kMax - p.kMin + 1;
+	const QRgb* rows[maxTaps];
+	int xIdx[maxTaps];
+
+	for (int tIdx = 0; tIdx < nTaps; tIdx++) {
+		rows[tIdx] = (const QRgb*)(bits + (size_t)(y0 + p.kMin + tIdx) * bpl);
+		xIdx[tIdx] = x0 + p.kMin + tIdx;
+	}
+
+	return sampleSeparable(rows, xIdx, nTaps, &p.lut[fixedFrac(fu) * nTaps], &p.lut[fixedFrac(fv) * nTaps]);
+}
+
+/**
+* Samples one pixel close to or outside the image border.
+* Taps outside the image are clamped to the border, the result is blended with the
+* background according to the part of the target pixel that is covered by the image.
+**/
+template <int method>
+QRgb sampleBorder(const uchar* bits, int bpl, int width, int height, const WarpParams& p, qint64 fu, qint64 fv) {
+
+	double u = fu / fixedOne + 0.5 - p.offset;
+	double v = fv / fixedOne + 0.5 - p.offset;
+
+	if (method == DkImageWarp::interp_nearest) {
+
+		if (u < 0 || v < 0 || u >= width || v >= height)
+			return p.bg;
+
+		return ((const QRgb*)(bits + (size_t)qFloor(v) * bpl))[qFloor(u)];
+	}
+
+	// coverage of the target pixel measured in target pixels
+	double covU = qBound(0.0, qMin(u, width - u) / p.gradU + 0.5, 1.0);
+	double covV = qBound(0.0, qMin(v, height - v) / p.gradV + 0.5, 1.0);
+	int cov = qRound(covU * covV * 256);
+
+	if (cov <= 0)
+		return p.bg;
+
+	int x0 = fixedFloor(fu);
+	int y0 = fixedFloor(fv);
+	int nTaps = p.kMax - p.kMin + 1;
+	const QRgb* rows[maxTaps];
+	int xIdx[maxTaps];
+
+	for (int tIdx = 0; tIdx < nTaps; tIdx++) {
+		rows[tIdx] = (const QRgb*)(bits + (size_t)qBound(0, y0 + p.kMin + tIdx, height - 1) * bpl);
+		xIdx[tIdx] = qBound(0, x0 + p.kMin + tIdx, width - 1);
+	}
+
+	QRgb val;
+
+	if (method == DkImageWarp::interp_linear)
+		val = sampleLinear(rows[0][xIdx[0]], rows[0][xIdx[1]], rows[1][xIdx[0]], rows[1][xIdx[1]], fixedFrac(fu), fixedFrac(fv));
+	else
+		val = sampleSeparable(rows, xIdx, nTaps, &p.lut[fixedFrac(fu) * nTaps], &p.lut[fixedFrac(fv) * nTaps]);
+
+	return (cov >= 256) ? val : blendPixel(val, p.bg, cov);
+}
+
+/**
+* Computes the target columns [xStart xEnd) of which c0 + x * dc lies within [lo hi).
+**/
+void clipSpan(double c0, double dc, double lo, double hi, double& xStart, double& xEnd) {
+
+	if (qAbs(dc) < 1e-12) {
+		if (c0 < lo || c0 >= hi)
+			xEnd = xStart;
+		return;
+	}
+
+	double x1 = (lo - c0) / dc;
+	double x2 = (hi - c0) / dc;
+
+	xStart = qMax(xStart, qMin(x1, x2));
+	xEnd = qMin(xEnd, qMax(x1, x2));
+}
+
+/**
+* Warps the target rows [rowStart rowEnd).
+* Each row is split into a left and right border part and the interior span
+* whose kernel taps are inside the source - and fully cover the target pixel.
+**/
+template <int method>
+void warpRows(const QImage& src, uchar* dstBits, int dstBytesPerLine, int dstWidth, const WarpParams& p, int rowStart, int rowEnd) {
+
+	const uchar* bits = src.constBits();
+	const int bpl = src.bytesPerLine();
+	const int w = src.width();
+	const int h = src.height();
+
+	const qint64 du = toFixed(p.m11);
+	const qint64 dv = toFixed(p.m12);
+
+	// valid range of the sampling coordinates in the interior
+	double loU = -p.kMin;
+	double loV = -p.kMin;
+	double hiU = w - p.kMax;
+	double hiV = h - p.kMax;
+
+	if (method != DkImageWarp::interp_nearest) {
+		loU = qMax(loU, 0.5 * p.gradU - 0.5);
+		loV = qMax(loV, 0.5 * p.gradV - 0.5);
+		hiU = qMin(hiU, w - 0.5 * p.gradU - 0.5);
+		hiV = qMin(hiV, h - 0.5 * p.gradV - 0.5);
+	}
+
+	for (int y = rowStart; y < rowEnd; y++) {
+
+		QRgb* dstPtr = reinterpret_cast<QRgb*>(dstBits + y * dstBytesPerLine);
+
+		// sampling coordinates of the first pixel center
+		double cu = p.m11 * 0.5 + p.m21 * (y + 0.5) + p.dx - 0.5 + p.offset;
+		double cv = p.m12 * 0.5 + p.m22 * (y + 0.5) + p.dy - 0.5 + p.offset;
+
+		double spanStart = 0, spanEnd = dstWidth;
+		clipSpan(cu, p.m11, loU, hiU, spanStart, spanEnd);
+		clipSpan(cv, p.m12, loV, hiV, spanStart, spanEnd);
+
+		// one pixel of safety margin for rounding
+		int xStart = qBound(0, qCeil(spanStart) + 1, dstWidth);
+		int xEnd = qBound(xStart, qFloor(spanEnd) - 1, dstWidth);
+
+		qint64 fu = toFixed(cu);
+		qint64 fv = toFixed(cv);
+		int x = 0;
+
+		for (; x < xStart; x++, fu += du, fv += dv)
+			dstPtr[x] = sampleBorder<method>(bits, bpl, w, h, p, fu, fv);
+
+		for (; x < xEnd; x++, fu += du, fv += dv)
+			dstPtr[x] = sampleInside<method>(bits, bpl, p, fu, fv);
+
+		for (; x < dstWidth; x++, fu += du, fv += dv)
+			dstPtr[x] = sampleBorder<method>(bits, bpl, w, h, p, fu, fv);
+	}
+}
+
+template <int method>
+void warpImage(const QImage& src, QImage& dst, const WarpParams& p) {
+
+	int bh = bandHeight(dst.size());
+
+	// scanLine() is non-const and may detach - the buffer is fetched once before the bands are dispatched
+	uchar* dstBits = dst.bits();
+	int dstBytesPerLine = dst.bytesPerLine();
+	int dstWidth = dst.width();
+
+	QVector<int> bands;
+	for (int y = 0; y < dst.height(); y += bh)
+		bands << y;
+
+	QtConcurrent::blockingMap(bands, [&](const int& rowStart) {
+		warpRows<method>(src, dstBits, dstBytesPerLine, dstWidth, p, rowStart, qMin(rowStart + bh, dst.height()));
+	});
+}
+
+};
+
+// DkImageWarp --------------------------------------------------------------------
+DkImageWarp::DkImageWarp(const QImage& img) {
+
+	interp = interp_linear;
+	bgColor = Qt::white;
+	srcFormat = QImage::Format_Invalid;
+	setImage(img);
+}
+
+/**
+* Sets the source image.
+* RGB32 and premultiplied ARGB32 images are shared, all other formats are converted once.
+**/
+void DkImageWarp::setImage(const QImage& img) {
+
+	srcFormat = img.format();
+
+	if (img.isNull() || img.format() == QImage::Format_RGB32 || img.format() == QImage::Format_ARGB32_Premultiplied)
+		src = img;
+	else if (img.hasAlphaChannel())
+		src = img.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	else
+		src = img.convertToFormat(QImage::Format_RGB32);
+}
+
+QImage DkImageWarp::image() const {
+	return src;
+}
+
+void DkImageWarp::setInterpolation(int method) {
+
+	if (method >= 0 && method < interp_end)
+		interp = method;
+}
+
+int DkImageWarp::interpolation() const {
+	return interp;
+}
+
+void DkImageWarp::setBackground(const QColor& col) {
+	bgColor = col;
+}
+
+QColor DkImageWarp::background() const {
+	return bgColor;
+}
+
+/**
+* Renders the source image with the given transformation.
+* @param transform maps source coordinates to target coordinates (only the affine part is used)
+* @param size the size of the target image - everything outside is not computed
+* @return the transformed image in the format of the source (if it can be painted to)
+**/
+QImage DkImageWarp::warp(const QTransform& transform, const QSize& size) const {
+
+	if (src.isNull() || size.isEmpty() || !transform.isInvertible())
+		return QImage();
+
+	QTransform inv = transform.inverted();
+
+	WarpParams p;
+	p.m11 = inv.m11();
+	p.m12 = inv.m12();
+	p.m21 = inv.m21();
+	p.m22 = inv.m22();
+	p.dx = inv.dx();
+	p.dy = inv.dy();
+	p.gradU = qMax(qSqrt(p.m11 * p.m11 + p.m21 * p.m21), 1e-6);
+	p.gradV = qMax(qSqrt(p.m12 * p.m12 + p.m22 * p.m22), 1e-6);
+	p.offset = 0;
+	p.bg = qPremultiply(bgColor.rgba());
+
+	switch (interp) {
+	case interp_nearest:	p.kMin = 0;		p.kMax = 0;	p.offset = 0.5;	break;
+	case interp_linear:		p.kMin = 0;		p.kMax = 1;	break;
+	case interp_cubic:		p.kMin = -1;	p.kMax = 2;	break;
+	default:				p.kMin = -2;	p.kMax = 3;	break;
+	}
+
+	if (interp == interp_cubic || interp == interp_lanczos)
+		p.lut = weightLut(interp, p.kMin, p.kMax);
+
+	bool opaque = src.format() == QImage::Format_RGB32 && bgColor.alpha() == 255;
+	QImage dst(size, opaque ? QImage::Format_RGB32 : QImage::Format_ARGB32_Premultiplied);
+
+	if (dst.isNull())
+		return QImage();
+
+	switch (interp) {
+	case interp_nearest:	warpImage<interp_nearest>(src, dst, p);	break;
+	case interp_linear:		warpImage<interp_linear>(src, dst, p);	break;
+	case interp_cubic:		warpImage<interp_cubic>(src, dst, p);	break;
+	default:				warpImage<interp_lanczos>(src, dst, p);	break;
+	}
+
+	// indexed images are not converted back since this would need a new color table
+	if (srcFormat != dst.format() && srcFormat != QImage::Format_Invalid &&
+		srcFormat != QImage::Format_Indexed8 && srcFormat != QImage::Format_Mono && srcFormat != QImage::Format_MonoLSB)
+		return dst.convertToFormat(srcFormat);
+
+	return dst;
+}
+
+/**
+* Returns the size of an image rotated by angle (in degree).
+* @param crop if true, the size of the cropped region without background is returned
+**/
+QSize DkImageWarp::rotatedSize(const QSize& size, double angle, bool crop) {
+
+	if (crop)
+		return cropSize(size, angle);
+
+	QTransform rotation;
+	rotation.rotate(angle);
+
+	return rotation.mapRect(QRect(QPoint(), size)).size();
+}
+
+/**
+* Returns the largest axis aligned rectangle (centered) within an image rotated by angle (in degree).
+* If the short side is long enough, all four corners touch the rotated image.
+* Otherwise two corners touch the long sides only (e.g. close to 45 degree).
+**/
+QSize DkImageWarp::cropSize(const QSize& size, double angle) {
+
+	if (size.isEmpty())
+		return QSize();
+
+	double sinA = qAbs(qSin(angle * pi / 180));
+	double cosA = qAbs(qCos(angle * pi / 180));
+
+	bool widthIsLonger = size.width() >= size.height();
+	double longSide = widthIsLonger ? size.width() : size.height();
+	double shortSide = widthIsLonger ? size.height() : size.width();
+
+	double width, height;
+
+	if (shortSide <= 2.0 * sinA * cosA * longSide || qAbs(sinA - cosA) < 1e-10) {
+
+		// half constrained
+		double x = 0.5 * shortSide;
+		width = widthIsLonger ? x / sinA : x / cosA;
+		height = widthIsLonger ? x / cosA : x / sinA;
+	}
+	else {
+
+		// fully constrained
+		double cos2A = cosA * cosA - sinA * sinA;
+		width = (size.width() * cosA - size.height() * sinA) / cos2A;
+		height = (size.height() * cosA - size.width() * sinA) / cos2A;
+	}
+
+	// round down so that no background is visible
+	return QSize(qMax(qFloor(width + 1e-6), 1), qMax(qFloor(height + 1e-6), 1));
+}
+
+/**
+* Returns the transformation that rotates an image of size around its center into outSize.
+**/
+QTransform DkImageWarp::rotationTransform(const QSize& size, const QSize& outSize, double angle) {
+
+	QTransform affineTransform;
+	affineTransform.translate(0.5*outSize.width(), 0.5*outSize.height());
+	affineTransform.rotate(angle); 
+	affineTransform.translate(-0.5*size.width(), -0.5*size.height());
+
+	return affineTransform;
+}
+
+};
@@ -0,0 +1,82 @@
+/*******************************************************************************************************
+ DkImageWarp.h
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include <QImage>
+#include <QTransform>
+#include <QColor>
+
+namespace nmp {
+
+/**
+*	Inverse mapping warp for affine transformations.
+*	Every target pixel center is mapped back into the source image and
+*	resampled with a nearest neighbor, bilinear, bicubic or Lanczos kernel.
+*	The source coordinates are stepped in fixed point along each scanline
+*	and row bands of the target are rendered concurrently. Images are
+*	resampled as premultiplied ARGB32, pixels which are (partly) mapped
+*	outside the source are blended with the background color.
+**/
+class DkImageWarp {
+
+public:
+
+	enum {
+		interp_nearest = 0,
+		interp_linear,
+		interp_cubic,
+		interp_lanczos,
+
+		interp_end,
+	};
+
+	DkImageWarp(const QImage& img = QImage());
+
+	void setImage(const QImage& img);
+	QImage image() const;
+
+	void setInterpolation(int method);
+	int interpolation() const;
+
+	void setBackground(const QColor& col);
+	QColor background() const;
+
+	QImage warp(const QTransform& transform, const QSize& size) const;
+
+	static QSize rotatedSize(const QSize& size, double angle, bool crop);
+	static QSize cropSize(const QSize& size, double angle);
+	static QTransform rotationTransform(const QSize& size, const QSize& outSize, double angle);
+
+protected:
+	QImage src;					// RGB32 or ARGB32_Premultiplied
+	QImage::Format srcFormat;	// format of the image that was set
+	int interp;
+	QColor bgColor;
+};
+
+};
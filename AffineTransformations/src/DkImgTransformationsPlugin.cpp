@@ -33,6 +33,7 @@
 #include "DkUtils.h"
 
 #include <QMouseEvent>
+#include <QtConcurrentRun>
 
 #define PI 3.14159265
 
@@ -130,6 +131,10 @@ DkImgTransformationsViewPort::DkImgTransformationsViewPort(QWidget* parent, Qt::
 
 DkImgTransformationsViewPort::~DkImgTransformationsViewPort() {
 
+	// the estimation must not outlive the viewport
+	cancelSkew();
+	skewWatcher.waitForFinished();
+
 	// active deletion since the MainWindow takes ownership...
 	// if we have issues with this, we could disconnect all signals between mViewport and toolbar too
 	// however, then we have lot's of toolbars in memory if the user opens the plugin again and again
@@ -142,12 +147,13 @@ DkImgTransformationsViewPort::~DkImgTransformationsViewPort() {
 void DkImgTransformationsViewPort::init() {
 
 	defaultMode = mode_scale;
-	QSettings settings;
+	QSettings& settings = nmc::DkSettingsManager::instance().qSettings();
 	settings.beginGroup("affineTransformPlugin");
     defaultMode = settings.value("mode", defaultMode).toInt();
     guideMode = settings.value("guideMode", guide_no_guide).toInt();
 	rotCropEnabled = (settings.value("cropEnabled", Qt::Unchecked).toInt() == Qt::Checked);
 	angleLinesEnabled = (settings.value("angleLines", Qt::Checked).toInt() == Qt::Checked);
+	interpolation = settings.value("interpolation", DkImageWarp::interp_linear).toInt();
     settings.endGroup();
 
 	selectedMode = defaultMode;
@@ -163,15 +169,28 @@ void DkImgTransformationsViewPort::init() {
 	insideIntrRect = false;
 	intrIdx = 100;
 	rotationCenter = QPoint();
+	previewKey = 0;
 
 	intrRect = new DkInteractionRects(this);
-	skewEstimator = DkSkewEstimator(this);
+
+	skewDialog = 0;
+	skewTimer = new QTimer(this);
+	skewTimer->setInterval(100);
+	connect(skewTimer, SIGNAL(timeout()), this, SLOT(updateSkewProgress()));
+	connect(&skewWatcher, SIGNAL(finished()), this, SLOT(skewFinished()));
+
+	// at most one render per display refresh while values are dragged
+	renderTimer = new QTimer(this);
+	renderTimer->setSingleShot(true);
+	renderTimer->setInterval(16);
+	connect(renderTimer, SIGNAL(timeout()), this, SLOT(renderPreview()));
 
 	imgTransformationsToolbar = new DkImgTransformationsToolBar(tr("ImgTransformations Toolbar"), defaultMode, this);
 
 	imgTransformationsToolbar->setCropState((rotCropEnabled) ? Qt::Checked : Qt::Unchecked);
 	imgTransformationsToolbar->setGuideLineState(guideMode);
 	imgTransformationsToolbar->setAngleLineState((angleLinesEnabled) ? Qt::Checked : Qt::Unchecked);
+	imgTransformationsToolbar->setInterpolation(interpolation);
 
 	connect(imgTransformationsToolbar, SIGNAL(scaleXValSignal(double)), this, SLOT(setScaleXValue(double)));
 	connect(imgTransformationsToolbar, SIGNAL(scaleYValSignal(double)), this, SLOT(setScaleYValue(double)));
@@ -183,6 +202,7 @@ void DkImgTransformationsViewPort::init() {
 	connect(imgTransformationsToolbar, SIGNAL(showLinesSignal(bool)), this, SLOT(	setAngleLinesEnabled(bool)));
 	connect(imgTransformationsToolbar, SIGNAL(modeChangedSignal(int)), this, SLOT(setMode(int)));
 	connect(imgTransformationsToolbar, SIGNAL(guideStyleSignal(int)), this, SLOT(setGuideStyle(int)));
+	connect(imgTransformationsToolbar, SIGNAL(interpolationSignal(int)), this, SLOT(setInterpolation(int)));
 	connect(imgTransformationsToolbar, SIGNAL(panSignal(bool)), this, SLOT(setPanning(bool)));
 	connect(imgTransformationsToolbar, SIGNAL(cancelSignal()), this, SLOT(discardChangesAndClose()));
 	connect(imgTransformationsToolbar, SIGNAL(applySignal()), this, SLOT(applyChangesAndClose()));
@@ -292,7 +312,7 @@ void DkImgTransformationsViewPort::mouseMoveEvent(QMouseEvent *event) {
 
 				
 				imgTransformationsToolbar->setScaleValue(scaleValues);
-				this->repaint();
+				requestRender();
 			}
 
 		}
@@ -377,14 +397,14 @@ void DkImgTransformationsViewPort::paintEvent(QPaintEvent *event) {
 		nmc::DkBaseViewPort* mViewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
 		if (mViewport) {
 
-			imgRect = mViewport->getImage().rect();
-			inImage = QImage(mViewport->getImage());
+			inImage = mViewport->getImage();
+			imgRect = inImage.rect();
 
 		}
 	}
 
 	QRect imgRectT = imgRect;
-	QTransform affineTransform = QTransform();
+	QTransform affineTransform = imageTransform(inImage.size());
 
 	QPainter painter(this);
 
@@ -399,33 +419,15 @@ void DkImgTransformationsViewPort::paintEvent(QPaintEvent *event) {
 
 		imgRectT.setSize(QSize(imgRectT.width()*scaleValues.x(),imgRectT.height()*scaleValues.y()));
 		imgRectT.translate(imgRectT.width()*0.5 *(1-scaleValues.x()) * (1/scaleValues.x()),imgRectT.height()*0.5*(1-scaleValues.y())*(1/scaleValues.y()));
-
-		affineTransform.scale(scaleValues.x(),scaleValues.y());
-		affineTransform.translate(inImage.width()*0.5 *(1-scaleValues.x()) * (1/scaleValues.x()),inImage.height()*0.5*(1-scaleValues.y())*(1/scaleValues.y()));
 	}
 	else if (selectedMode == mode_rotate) {
 		painter.save();
 
-		double diag = qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width());
-		double initAngle = qAcos(inImage.width()/diag) * 180 / PI;	
-		affineTransform.translate(0.5* inImage.width() - diag*0.5*qCos((initAngle+rotationValue) * PI / 180.0), 0.5* inImage.height() - diag*0.5*qSin((initAngle+rotationValue) * PI / 180.0));
-		affineTransform.rotate(rotationValue);
-
 		painter.fillRect(affineTransform.mapRect(inImage.rect()), Qt::white);
 		imgRectT = affineTransform.mapRect(inImage.rect());
 	}
 	else if (selectedMode == mode_shear) {
 
-		affineTransform.shear(shearValues.x(), shearValues.y());
-
-		QRect transfRect = affineTransform.mapRect(inImage.rect());
-		int signX = (shearValues.x() < 0) ? -1 : 1;
-		int signY = (shearValues.y() < 0) ? -1 : 1;
-
-		affineTransform.reset();
-		affineTransform.translate(signX*(inImage.width()/2-transfRect.width()/2), signY*(inImage.height()/2-transfRect.height()/2));
-		affineTransform.shear(shearValues.x(),shearValues.y());
-
 		painter.fillRect(affineTransform.mapRect(inImage.rect()), Qt::white);
 	}
 	
@@ -433,7 +435,39 @@ void DkImgTransformationsViewPort::paintEvent(QPaintEvent *event) {
 	
 	painter.setTransform(affineTransform);
 
-	painter.drawImage(inImage.rect(), inImage);
+	// draw the mip level that matches the display resolution
+	int level = previewLevel(inImage, affineTransform);
+	QImage mip = previewImage(inImage, level);
+
+	if (selectedMode == mode_rotate && !mip.isNull()) {
+
+		// rotated tiles are drawn in widget coordinates - only the exposed ones
+		QTransform mipTransform = QTransform::fromScale((double)inImage.width() / mip.width(), (double)inImage.height() / mip.height()) * affineTransform;
+
+		// a dragged rotation changes the transform with every frame - the tiles
+		// are only cached once the transform did not change for a render tick
+		bool stable = !renderTimer->isActive() &&
+			mipTransform.m11() == tileTransform.m11() && mipTransform.m12() == tileTransform.m12() &&
+			mipTransform.m21() == tileTransform.m21() && mipTransform.m22() == tileTransform.m22();
+		tileTransform = mipTransform;
+
+		painter.save();
+		painter.resetTransform();
+		previewTiles.draw(&painter, mip, mipTransform, event->region(), level > 0, stable);
+		painter.restore();
+
+		if (!stable)
+			requestRender();	// renders (and caches) the same transform one tick later
+	}
+	else {
+		if (level > 0)
+			painter.setRenderHint(QPainter::SmoothPixmapTransform);
+
+		painter.drawImage(QRectF(inImage.rect()), mip);
+		painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+	}
+
+	paintedRect = previewRect(inImage.size());
 	
 	drawGuide(&painter, QPolygonF(QRectF(imgRect)), guideMode);
 	painter.drawRect(imgRect);
@@ -461,24 +495,19 @@ void DkImgTransformationsViewPort::paintEvent(QPaintEvent *event) {
 		}
 
 		painter.restore();
-		if (rotCropEnabled) {
-			QSize cropSize = QSize();
+		if (rotCropEnabled && !inImage.isNull()) {
 
-			double newHeight = - ((double)(inImage.height()) - (double) (inImage.width()) * qAbs(qTan(rotationValue * PI /180))) / (qAbs(qTan(rotationValue * PI /180))*qAbs(qSin(rotationValue * PI /180))-qAbs(qCos(rotationValue * PI /180)));
-			cropSize = QSize(((double) (inImage.width())-newHeight*qAbs(qSin(rotationValue * PI /180)))/qAbs(qCos(rotationValue * PI /180)) , newHeight);
-			QRect cropRect = QRect(QPoint(rotationCenter.x()-0.5*cropSize.width(),rotationCenter.y()-0.5*cropSize.height()),cropSize);
-		
-			if (cropSize.width() <= qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width()) && cropSize.height() <= qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width())) {
-				
-				QBrush cropBrush = QBrush(QColor(128, 128, 128, 200));
-				painter.fillRect(imgRectT.left(), imgRectT.top(), imgRectT.width(), -imgRectT.top()+cropRect.top(), cropBrush);
-				painter.fillRect(imgRectT.left(), cropRect.bottom()+1, imgRectT.width(), -cropRect.bottom()+imgRectT.bottom(), cropBrush);
-				painter.fillRect(imgRectT.left(), cropRect.top(), cropRect.left()-imgRectT.left(), cropRect.height(), cropBrush);
-				painter.fillRect(cropRect.right()+1, cropRect.top(), -cropRect.right()+imgRectT.right(), cropRect.height(), cropBrush);
+			// the same region is rendered by getTransformedImage
+			QSize crop = DkImageWarp::cropSize(inImage.size(), rotationValue);
+			QRect cropRect = QRect(QPoint(rotationCenter.x()-0.5*crop.width(),rotationCenter.y()-0.5*crop.height()),crop);
 
-				painter.drawRect(cropRect);
+			QBrush cropBrush = QBrush(QColor(128, 128, 128, 200));
+			painter.fillRect(imgRectT.left(), imgRectT.top(), imgRectT.width(), -imgRectT.top()+cropRect.top(), cropBrush);
+			painter.fillRect(imgRectT.left(), cropRect.bottom()+1, imgRectT.width(), -cropRect.bottom()+imgRectT.bottom(), cropBrush);
+			painter.fillRect(imgRectT.left(), cropRect.top(), cropRect.left()-imgRectT.left(), cropRect.height(), cropBrush);
+			painter.fillRect(cropRect.right()+1, cropRect.top(), -cropRect.right()+imgRectT.right(), cropRect.height(), cropBrush);
 
-			}
+			painter.drawRect(cropRect);
 		}
 	}
 	
@@ -488,6 +517,132 @@ void DkImgTransformationsViewPort::paintEvent(QPaintEvent *event) {
 	DkPluginViewPort::paintEvent(event);
 }
 
+/**
+* Returns the transformation of the preview (in image coordinates) for the current mode.
+**/
+QTransform DkImgTransformationsViewPort::imageTransform(const QSize& size) const {
+
+	QTransform affineTransform = QTransform();
+
+	if (selectedMode == mode_scale) {
+
+		affineTransform.scale(scaleValues.x(),scaleValues.y());
+		affineTransform.translate(size.width()*0.5 *(1-scaleValues.x()) * (1/scaleValues.x()),size.height()*0.5*(1-scaleValues.y())*(1/scaleValues.y()));
+	}
+	else if (selectedMode == mode_rotate) {
+
+		double diag = qSqrt(size.height()*size.height()+size.width()*size.width());
+		double initAngle = qAcos(size.width()/diag) * 180 / PI;	
+		affineTransform.translate(0.5* size.width() - diag*0.5*qCos((initAngle+rotationValue) * PI / 180.0), 0.5* size.height() - diag*0.5*qSin((initAngle+rotationValue) * PI / 180.0));
+		affineTransform.rotate(rotationValue);
+	}
+	else if (selectedMode == mode_shear) {
+
+		affineTransform.shear(shearValues.x(), shearValues.y());
+
+		QRect transfRect = affineTransform.mapRect(QRect(QPoint(), size));
+		int signX = (shearValues.x() < 0) ? -1 : 1;
+		int signY = (shearValues.y() < 0) ? -1 : 1;
+
+		affineTransform.reset();
+		affineTransform.translate(signX*(size.width()/2-transfRect.width()/2), signY*(size.height()/2-transfRect.height()/2));
+		affineTransform.shear(shearValues.x(),shearValues.y());
+	}
+
+	return affineTransform;
+}
+
+/**
+* Returns the widget region that is covered by the preview.
+* Only rotation and shear are bounded, the scale handles may be anywhere.
+**/
+QRect DkImgTransformationsViewPort::previewRect(const QSize& size) const {
+
+	if (size.isEmpty() || (selectedMode != mode_rotate && selectedMode != mode_shear))
+		return rect();
+
+	// white background, lines and the outline (pen widths)
+	int margin = qCeil(2.0 * size.width() / 1000.0) + 1;
+	QRectF box = QRectF(imageTransform(size).mapRect(QRect(QPoint(), size))).adjusted(-margin, -margin, margin, margin);
+
+	if (mWorldMatrix)
+		box = ((*mImgMatrix) * (*mWorldMatrix)).mapRect(box);
+
+	return box.toAlignedRect().adjusted(-2, -2, 2, 2) & rect();
+}
+
+/**
+* Schedules a render of the preview.
+* Changes within one timer tick are rendered once, only the region of the
+* last and the new preview is updated.
+**/
+void DkImgTransformationsViewPort::requestRender() {
+
+	dirtyRegion += paintedRect;
+
+	if (!renderTimer->isActive())
+		renderTimer->start();
+}
+
+void DkImgTransformationsViewPort::renderPreview() {
+
+	QSize size;
+
+	if (parent()) {
+		nmc::DkBaseViewPort* mViewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
+		if (mViewport)
+			size = mViewport->getImage().size();
+	}
+
+	dirtyRegion += previewRect(size);
+	update(dirtyRegion);
+	dirtyRegion = QRegion();
+}
+
+/**
+* Returns the mip level whose resolution matches the display transform.
+* Level 0 is the image itself, each level halves its size.
+**/
+int DkImgTransformationsViewPort::previewLevel(const QImage& img, const QTransform& displayTransform) const {
+
+	// use the larger axis scale so that no direction is shown below its resolution
+	double scaleX = qSqrt(displayTransform.m11()*displayTransform.m11() + displayTransform.m12()*displayTransform.m12());
+	double scaleY = qSqrt(displayTransform.m21()*displayTransform.m21() + displayTransform.m22()*displayTransform.m22());
+	double scale = qMax(scaleX, scaleY);
+
+	int level = 0;
+	int minSide = qMin(img.width(), img.height());
+
+	while (scale > 0.0 && scale <= 0.5 && (minSide >> (level + 1)) > 0) {
+		scale *= 2.0;
+		level++;
+	}
+
+	return level;
+}
+
+/**
+* Returns the mip level of the image.
+* The pyramid is kept until the viewport image changes.
+**/
+QImage DkImgTransformationsViewPort::previewImage(const QImage& img, int level) {
+
+	if (img.cacheKey() != previewKey) {
+		previewPyramid.clear();
+		previewKey = img.cacheKey();
+	}
+
+	if (previewPyramid.isEmpty())
+		previewPyramid << img;
+
+	while (previewPyramid.size() <= level) {
+		const QImage& mip = previewPyramid.last();
+		previewPyramid << mip.scaled(qMax(mip.width() / 2, 1), qMax(mip.height() / 2, 1), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	}
+
+	return previewPyramid[level];
+}
+
 void DkImgTransformationsViewPort::drawGuide(QPainter* painter, const QPolygonF& p, int paintMode) {
 
 	if (p.isEmpty() || paintMode == guide_no_guide)
@@ -550,80 +705,35 @@ QImage DkImgTransformationsViewPort::getTransformedImage() {
 
 			QImage inImage = mViewport->getImage();
 			QTransform affineTransform = QTransform();
+			QSize outSize;
 			
 			if (selectedMode == mode_scale) {
 
 				affineTransform.scale(scaleValues.x(),scaleValues.y());
-
-				QImage paintedImage = QImage(affineTransform.mapRect(inImage.rect()).size(), inImage.format());
-				QPainter imagePainter(&paintedImage);
-				imagePainter.setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
-				imagePainter.setTransform(affineTransform);
-				imagePainter.drawImage(QPoint(0,0), inImage);
-				imagePainter.end();
-
-				return paintedImage;
+				outSize = affineTransform.mapRect(inImage.rect()).size();
 			}
-			else if (selectedMode == mode_rotate) {			
-			
-				double diag = qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width());
-				double initAngle = qAcos(inImage.width()/diag) * 180 / PI;	
-				affineTransform.translate(0.5* inImage.width() - diag*0.5*qCos((initAngle+rotationValue) * PI / 180.0), 0.5* inImage.height() - diag*0.5*qSin((initAngle+rotationValue) * PI / 180.0));
-				affineTransform.rotate(rotationValue);
-				affineTransform.translate(-inImage.width()/2, -inImage.height()/2); 
-
-				QImage paintedImage = QImage(affineTransform.mapRect(inImage.rect()).size(), inImage.format());
-				QPainter imagePainter(&paintedImage);
-				imagePainter.setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
-				imagePainter.fillRect(paintedImage.rect(), Qt::white);		
-				affineTransform.reset();
-				affineTransform.translate(paintedImage.width()/2, paintedImage.height()/2);
-				affineTransform.rotate(rotationValue); 
-				affineTransform.translate(-inImage.width()/2, -inImage.height()/2);
-				imagePainter.setTransform(affineTransform);
-				imagePainter.drawImage(QPoint(0,0), inImage);
-				imagePainter.end();
-			
-				if (rotCropEnabled) {
+			else if (selectedMode == mode_rotate) {
 
-					QRect croppedImageRect = paintedImage.rect();
-
-					QSize cropSize = QSize();
-					double newHeight = - ((double)(inImage.height()) - (double) (inImage.width()) * qAbs(qTan(rotationValue * PI /180))) / (qAbs(qTan(rotationValue * PI /180))*qAbs(qSin(rotationValue * PI /180))-qAbs(qCos(rotationValue * PI /180)));
-					cropSize = QSize(((double) (inImage.width())-newHeight*qAbs(qSin(rotationValue * PI /180)))/qAbs(qCos(rotationValue * PI /180)) , newHeight);
-					if (cropSize.width() <= qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width()) && cropSize.height() <= qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width())) croppedImageRect = QRect(QPoint(0.5*paintedImage.width()-0.5*cropSize.width(),0.5*paintedImage.height()-0.5*cropSize.height()),cropSize);
-					QImage croppedImage = paintedImage.copy(croppedImageRect);
-
-					return croppedImage;
-				}	
-				return paintedImage;
+				outSize = DkImageWarp::rotatedSize(inImage.size(), rotationValue, rotCropEnabled);
+				affineTransform = DkImageWarp::rotationTransform(inImage.size(), outSize, rotationValue);
 			}
 			else if (selectedMode == mode_shear) {			
 			
 				affineTransform.shear(shearValues.x(), shearValues.y());
-				/*
-				QRect transfRect = affineTransform.mapRect(inImage.rect());
-				int signX = (shearValues.x() < 0) ? -1 : 1;
-				int signY = (shearValues.y() < 0) ? -1 : 1;
+				outSize = affineTransform.mapRect(inImage.rect()).size();
 
 				affineTransform.reset();
-				affineTransform.translate(signX*(inImage.width()/2-transfRect.width()/2), signY*(inImage.height()/2-transfRect.height()/2));
+				affineTransform.translate(0.5*outSize.width(), 0.5*outSize.height());
 				affineTransform.shear(shearValues.x(),shearValues.y());
-				*/
-				QImage paintedImage = QImage(affineTransform.mapRect(inImage.rect()).size(), inImage.format());
-				QPainter imagePainter(&paintedImage);
-				imagePainter.setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
-				imagePainter.fillRect(paintedImage.rect(), Qt::white);		
-				affineTransform.reset();
-				affineTransform.translate(paintedImage.width()/2, paintedImage.height()/2);
-				affineTransform.shear(shearValues.x(),shearValues.y());
-				affineTransform.translate(-inImage.width()/2, -inImage.height()/2);
-				imagePainter.setTransform(affineTransform);
-				imagePainter.drawImage(QPoint(0,0), inImage);
-				imagePainter.end();
-
-				return paintedImage;
+				affineTransform.translate(-0.5*inImage.width(), -0.5*inImage.height());
 			}
+
+			// inverse mapping renders exactly the output size
+			DkImageWarp warp(inImage);
+			warp.setInterpolation(interpolation);
+			warp.setBackground(Qt::white);
+
+			return warp.warp(affineTransform, outSize);
 		}
 	}
 
@@ -644,32 +754,32 @@ void DkImgTransformationsViewPort::setMode(int mode) {
 void DkImgTransformationsViewPort::setScaleXValue(double val) {
 
 	this->scaleValues.setX(val);
-	this->repaint();
+	requestRender();
 }
 
 void DkImgTransformationsViewPort::setScaleYValue(double val) {
 
 	this->scaleValues.setY(val);
-	this->repaint();
+	requestRender();
 }
 
 void DkImgTransformationsViewPort::setShearXValue(double val) {
 
 	this->shearValues.setX(val);
-	this->repaint();
+	requestRender();
 }
 
 void DkImgTransformationsViewPort::setShearYValue(double val) {
 
 	this->shearValues.setY(val);
-	this->repaint();
+	requestRender();
 }
 
 void DkImgTransformationsViewPort::setRotationValue(double val) {
 
 	if (val < 0) val += 360;
 	this->rotationValue = val;
-	this->repaint();
+	requestRender();
 }
 
 void DkImgTransformationsViewPort::setCropEnabled(bool enabled) {
@@ -684,8 +794,15 @@ void DkImgTransformationsViewPort::setAngleLinesEnabled(bool enabled) {
 	this->repaint();
 }
 
+/**
+* Estimates the skew angle in a background task.
+* The progress dialog is updated from the GUI thread and cancels the task.
+**/
 void DkImgTransformationsViewPort::calculateAutoRotation() {
 	
+	if (skewWatcher.isRunning())
+		return;
+
 	if(parent()) {
 		nmc::DkBaseViewPort* mViewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
 		if (mViewport) {
@@ -694,11 +811,26 @@ void DkImgTransformationsViewPort::calculateAutoRotation() {
 
 			if (img.width() > 10 && img.height() > 10) {
 				
-				skewEstimator.setImage(img);
-				rotationValue = skewEstimator.getSkewAngle();
-				if (rotationValue < 0) rotationValue += 360;
-				imgTransformationsToolbar->setRotationValue(rotationValue);
-				this->repaint();
+				skewTask = QSharedPointer<DkSkewEstimator>(new DkSkewEstimator());
+				skewProgress = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+				skewAbort = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+
+				skewDialog = new QProgressDialog(tr("Calculating angle..."), tr("Cancel"), 0, DkSkewEstimator::progress_end, this);
+				skewDialog->setMinimumDuration(250);
+				skewDialog->setWindowModality(Qt::WindowModal);
+				skewDialog->setValue(0);
+				connect(skewDialog, SIGNAL(canceled()), this, SLOT(cancelSkew()));
+				skewTimer->start();
+
+				// the task only holds shared pointers - it never touches the viewport
+				QSharedPointer<DkSkewEstimator> estimator = skewTask;
+				QSharedPointer<QAtomicInt> progress = skewProgress;
+				QSharedPointer<QAtomicInt> abort = skewAbort;
+
+				skewWatcher.setFuture(QtConcurrent::run([img, estimator, progress, abort]() {
+					estimator->setImage(img);
+					return estimator->getSkewAngle(progress.data(), abort.data());
+				}));
 				return;
 			}
 		}
@@ -709,6 +841,41 @@ void DkImgTransformationsViewPort::calculateAutoRotation() {
 	
 }
 
+void DkImgTransformationsViewPort::skewFinished() {
+
+	skewTimer->stop();
+
+	if (skewDialog) {
+		skewDialog->blockSignals(true);	// closing emits canceled()
+		skewDialog->close();
+		skewDialog->deleteLater();
+		skewDialog = 0;
+	}
+
+	if (!skewTask || skewAbort->load())
+		return;
+
+	skewEstimator = *skewTask;
+	skewTask.clear();
+
+	rotationValue = skewWatcher.result();
+	if (rotationValue < 0) rotationValue += 360;
+	imgTransformationsToolbar->setRotationValue(rotationValue);
+	this->repaint();
+}
+
+void DkImgTransformationsViewPort::updateSkewProgress() {
+
+	if (skewDialog && skewProgress)
+		skewDialog->setValue(qMin((int)skewProgress->load(), DkSkewEstimator::progress_end - 1));
+}
+
+void DkImgTransformationsViewPort::cancelSkew() {
+
+	if (skewAbort)
+		skewAbort->store(1);
+}
+
 void DkImgTransformationsViewPort::setPanning(bool checked) {
 
 	this->panning = checked;
@@ -739,6 +906,11 @@ void DkImgTransformationsViewPort::setGuideStyle(int guideMode) {
 	this->repaint();
 }
 
+void DkImgTransformationsViewPort::setInterpolation(int interpolation) {
+
+	this->interpolation = interpolation;
+}
+
 void DkImgTransformationsViewPort::setVisible(bool visible) {
 
 	if(parent()) {
@@ -754,6 +926,13 @@ void DkImgTransformationsViewPort::setVisible(bool visible) {
 
 	if (imgTransformationsToolbar) emit showToolbar(imgTransformationsToolbar, visible);
 
+	// the mip levels are not needed once the plugin is closed
+	if (!visible) {
+		previewPyramid.clear();
+		previewKey = 0;
+		previewTiles.clear();
+	}
+
 	setMode(defaultMode);
 	DkPluginViewPort::setVisible(visible);
 }
@@ -907,6 +1086,19 @@ void DkImgTransformationsToolBar::createLayout(int defaultMode) {
 	guideBox->setToolTip(tr("Show Guides in the Preview"));
 	guideBox->setStatusTip(guideBox->toolTip());
 
+	// resampling of the final image
+	QStringList interpolations;
+	interpolations <<	QT_TRANSLATE_NOOP("nmc::DkImgTransformationsToolBar", "Nearest Neighbor") << 
+						QT_TRANSLATE_NOOP("nmc::DkImgTransformationsToolBar", "Bilinear") << 
+						QT_TRANSLATE_NOOP("nmc::DkImgTransformationsToolBar", "Bicubic") << 
+						QT_TRANSLATE_NOOP("nmc::DkImgTransformationsToolBar", "Lanczos");
+	interpolationBox = new QComboBox(this);
+	interpolationBox->addItems(interpolations);
+	interpolationBox->setCurrentIndex(DkImageWarp::interp_linear);
+	interpolationBox->setObjectName("interpolationBox");
+	interpolationBox->setToolTip(tr("Interpolation of the transformed image"));
+	interpolationBox->setStatusTip(interpolationBox->toolTip());
+
 
 	QActionGroup* modesGroup = new QActionGroup(this);
     modesGroup->addAction(scaleAction);
@@ -950,6 +1142,7 @@ void DkImgTransformationsToolBar::createLayout(int defaultMode) {
 	toolbarWidgetList.insert(shearYBox->objectName(), this->addWidget(shearYBox));
 	addSeparator();
 	addWidget(guideBox);
+	addWidget(interpolationBox);
 
 	modifyLayout(defaultMode);
 }
@@ -1107,6 +1300,12 @@ void DkImgTransformationsToolBar::on_guideBox_currentIndexChanged(int val) {
 	emit guideStyleSignal(val);
 }
 
+void DkImgTransformationsToolBar::on_interpolationBox_currentIndexChanged(int val) {
+
+	updateAffineTransformPluginSettings(val, settings_interpolation);
+	emit interpolationSignal(val);
+}
+
 void DkImgTransformationsToolBar::setRotationValue(double val) {
 
 	if (val > 180) val -= 360;
@@ -1140,9 +1339,14 @@ void DkImgTransformationsToolBar::setAngleLineState(int val) {
 	showLinesBox->setChecked(val);
 }
 
+void DkImgTransformationsToolBar::setInterpolation(int val) {
+
+	interpolationBox->setCurrentIndex(val);
+}
+
 void DkImgTransformationsToolBar::updateAffineTransformPluginSettings(int val, int type) {
 	
-	QSettings settings;
+	QSettings& settings = nmc::DkSettingsManager::instance().qSettings();
 
 	switch(type) {
 		case settings_mode:
@@ -1157,6 +1361,9 @@ void DkImgTransformationsToolBar::updateAffineTransformPluginSettings(int val, i
 		case settings_lines:
 			settings.setValue("affineTransformPlugin/angleLines", val);
 			break;
+		case settings_interpolation:
+			settings.setValue("affineTransformPlugin/interpolation", val);
+			break;
 	}
 }
 
@@ -48,9 +48,16 @@
 #include <QVector4D>
 #include <QSettings>
 #include <QMouseEvent>
+#include <QProgressDialog>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QTimer>
 
 #include "DkPluginInterface.h"
 #include "DkSkewEstimator.h"
+#include "DkImageWarp.h"
+#include "DkPreviewTiles.h"
 
 namespace nmp {
 
@@ -121,10 +128,15 @@ public slots:
 	void setCropEnabled(bool enabled);
 	void setAngleLinesEnabled(bool enabled);
 	void setGuideStyle(int guideMode);
+	void setInterpolation(int interpolation);
 
 protected slots:
 		
 	void setMode(int mode);
+	void skewFinished();
+	void updateSkewProgress();
+	void cancelSkew();
+	void renderPreview();
 
 protected:
 
@@ -135,6 +147,11 @@ protected:
 	QPoint map(const QPointF &pos);
 	virtual void init();
 	void drawGuide(QPainter* painter, const QPolygonF& p, int paintMode);
+	int previewLevel(const QImage& img, const QTransform& displayTransform) const;
+	QImage previewImage(const QImage& img, int level);
+	QTransform imageTransform(const QSize& size) const;
+	QRect previewRect(const QSize& size) const;
+	void requestRender();
 
 	bool cancelTriggered;
 	bool panning;
@@ -157,8 +174,23 @@ protected:
 	QCursor rotatingCursor;
 	bool rotCropEnabled;
 	DkSkewEstimator skewEstimator;
+	QFutureWatcher<double> skewWatcher;
+	QSharedPointer<DkSkewEstimator> skewTask;	// estimator of the running task
+	QSharedPointer<QAtomicInt> skewProgress;
+	QSharedPointer<QAtomicInt> skewAbort;
+	QProgressDialog* skewDialog;
+	QTimer* skewTimer;
 	bool angleLinesEnabled;
 	int guideMode;
+	int interpolation;
+
+	QVector<QImage> previewPyramid;		// mip levels of the viewport image, built on demand
+	qint64 previewKey;					// cache key of the image the pyramid belongs to
+	DkPreviewTiles previewTiles;		// rotated tiles of the mip levels
+	QTransform tileTransform;			// transform of the last rotated preview
+	QTimer* renderTimer;				// coalesces value changes to one render per tick
+	QRegion dirtyRegion;				// widget region that needs to be rendered
+	QRect paintedRect;					// widget region covered by the last preview
 };
 
 
@@ -184,6 +216,7 @@ public:
 		settings_guide,
 		settings_crop,
 		settings_lines,
+		settings_interpolation,
 
 		guide_end,
 	};
@@ -197,6 +230,7 @@ public:
 	void setCropState(int val);
 	void setGuideLineState(int val);
 	void setAngleLineState(int val);
+	void setInterpolation(int val);
 
 public slots:
 	void on_applyAction_triggered();
@@ -214,6 +248,7 @@ public slots:
 	void on_showLinesBox_stateChanged(int val);
 	void on_autoRotateButton_clicked();
 	void on_guideBox_currentIndexChanged(int val);
+	void on_interpolationBox_currentIndexChanged(int val);
 	virtual void setVisible(bool visible);
 
 signals:
@@ -230,6 +265,7 @@ signals:
 	void panSignal(bool checked);
 	void modeChangedSignal(int mode);
 	void guideStyleSignal(int guideMode);
+	void interpolationSignal(int interpolation);
 
 protected:
 	void createLayout(int defaultMode);
@@ -247,6 +283,7 @@ protected:
 	QCheckBox* showLinesBox;
 	QMap<QString, QAction*> toolbarWidgetList;
 	QComboBox* guideBox;
+	QComboBox* interpolationBox;
 
 	QAction* panAction;
 	QAction* scaleAction;
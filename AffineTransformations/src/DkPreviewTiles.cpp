@@ -0,0 +1,156 @@
+/*******************************************************************************************************
+ DkPreviewTiles.cpp
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkPreviewTiles.h"
+
+#include <QtCore/qmath.h>
+
+namespace nmp {
+
+bool DkTileKey::operator==(const DkTileKey& o) const {
+
+	return image == o.image && col == o.col && row == o.row &&
+		m11 == o.m11 && m12 == o.m12 && m21 == o.m21 && m22 == o.m22 &&
+		dx == o.dx && dy == o.dy;
+}
+
+uint qHash(const DkTileKey& key, uint seed) {
+
+	uint h = ::qHash(key.image, seed);
+	h = h * 31 + ::qHash(key.col);
+	h = h * 31 + ::qHash(key.row);
+	h = h * 31 + ::qHash(key.m11);
+	h = h * 31 + ::qHash(key.m12);
+	h = h * 31 + ::qHash(key.m21);
+	h = h * 31 + ::qHash(key.m22);
+	h = h * 31 + ::qHash(key.dx);
+	h = h * 31 + ::qHash(key.dy);
+
+	return h;
+}
+
+DkPreviewTiles::DkPreviewTiles(int tileSize, int maxKiloBytes) {
+
+	this->tileSize = qMax(tileSize, 16);
+	tiles.setMaxCost(maxKiloBytes);
+}
+
+/**
+* Draws the image with the transform.
+* The painter has to be in device coordinates (no transform).
+* @param img the (mip level) image to be drawn
+* @param transform maps img to device coordinates
+* @param exposed the region that needs to be painted
+* @param cache if false, the image is drawn directly and no tiles are inserted
+**/
+void DkPreviewTiles::draw(QPainter* painter, const QImage& img, const QTransform& transform, const QRegion& exposed, bool smooth, bool cache) {
+
+	if (img.isNull() || !painter)
+		return;
+
+	// a transform that is not stable yet would only evict the tiles worth keeping
+	if (!cache) {
+		painter->save();
+		painter->setClipRegion(exposed, Qt::IntersectClip);
+		painter->setRenderHint(QPainter::SmoothPixmapTransform, smooth);
+		painter->setTransform(transform);
+		painter->drawImage(QPointF(), img);
+		painter->restore();
+		return;
+	}
+
+	int nCols = (img.width() + tileSize - 1) / tileSize;
+	int nRows = (img.height() + tileSize - 1) / tileSize;
+
+	DkTileKey key;
+	key.image = img.cacheKey();
+	key.m11 = transform.m11();
+	key.m12 = transform.m12();
+	key.m21 = transform.m21();
+	key.m22 = transform.m22();
+
+	for (int row = 0; row < nRows; row++) {
+		for (int col = 0; col < nCols; col++) {
+
+			QRect tileRect = QRect(col * tileSize, row * tileSize, tileSize, tileSize) & img.rect();
+			QRectF tileBox = transform.mapRect(QRectF(tileRect));
+
+			if (!exposed.intersects(tileBox.toAlignedRect()))
+				continue;
+
+			// the tile is rendered relative to its integer origin
+			QPoint origin(qFloor(tileBox.left()), qFloor(tileBox.top()));
+			key.col = col;
+			key.row = row;
+			key.dx = qRound((transform.dx() - origin.x()) * 16.0);
+			key.dy = qRound((transform.dy() - origin.y()) * 16.0);
+
+			QImage* cached = tiles.object(key);
+			QImage tile = cached ? *cached : QImage();
+
+			if (tile.isNull()) {
+				QTransform tileTransform(key.m11, key.m12, key.m21, key.m22, key.dx / 16.0, key.dy / 16.0);
+				tile = renderTile(img, tileRect, tileTransform, smooth);
+				tiles.insert(key, new QImage(tile), qMax(tile.byteCount() / 1024, 1));	// shallow copy
+			}
+
+			painter->drawImage(origin, tile);
+		}
+	}
+}
+
+void DkPreviewTiles::clear() {
+
+	tiles.clear();
+}
+
+/**
+* Renders a tile with the transform (which maps the tile into the positive quadrant).
+* The source is read with a margin of one pixel so that interpolated tiles match
+* their neighbors, the result is clipped to the exact tile.
+**/
+QImage DkPreviewTiles::renderTile(const QImage& img, const QRect& tileRect, const QTransform& transform, bool smooth) const {
+
+	QRectF box = transform.mapRect(QRectF(tileRect));
+	QSize size(qMax(qCeil(box.right()) + 1, 1), qMax(qCeil(box.bottom()) + 1, 1));
+
+	QImage tile(size, QImage::Format_ARGB32_Premultiplied);
+	tile.fill(Qt::transparent);
+
+	QRect srcRect = tileRect.adjusted(-1, -1, 1, 1) & img.rect();
+
+	QPainter p(&tile);
+	p.setRenderHint(QPainter::SmoothPixmapTransform, smooth);
+	p.setTransform(transform);
+	p.setClipRect(QRectF(tileRect));
+	p.drawImage(QRectF(srcRect), img, QRectF(srcRect));
+	p.end();
+
+	return tile;
+}
+
+};
@@ -0,0 +1,79 @@
+/*******************************************************************************************************
+ DkPreviewTiles.h
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include <QImage>
+#include <QTransform>
+#include <QRegion>
+#include <QCache>
+#include <QPainter>
+
+namespace nmp {
+
+/**
+*	Key of a transformed tile. Tiles are rendered in device coordinates,
+*	their translation is only stored as fraction of a pixel so that panning
+*	by whole pixels reuses them.
+**/
+struct DkTileKey {
+	qint64 image;	// cache key of the (mip level) image
+	int col;
+	int row;
+	double m11, m12, m21, m22;
+	int dx, dy;		// fractional translation in 1/16 pixel
+
+	bool operator==(const DkTileKey& o) const;
+};
+
+uint qHash(const DkTileKey& key, uint seed = 0);
+
+/**
+*	Draws transformed images tile by tile.
+*	Only tiles that intersect the exposed region are drawn. Transformed tiles
+*	are kept in a LRU cache whose size is bounded, so repaints with the same
+*	transform (exposes, overlays, panning) do not resample the image again.
+*	Tiles of images that changed are never hit again and drop out of the cache.
+*	While the transform changes (e.g. a rotation is dragged) every frame would
+*	miss all tiles, such frames are drawn directly without caching.
+**/
+class DkPreviewTiles {
+
+public:
+	DkPreviewTiles(int tileSize = 256, int maxKiloBytes = 64*1024);
+
+	void draw(QPainter* painter, const QImage& img, const QTransform& transform, const QRegion& exposed, bool smooth, bool cache = true);
+	void clear();
+
+protected:
+	QImage renderTile(const QImage& img, const QRect& tileRect, const QTransform& transform, bool smooth) const;
+
+	int tileSize;
+	QCache<DkTileKey, QImage> tiles;	// cost in kB
+};
+
+};
@@ -26,15 +26,204 @@
  *******************************************************************************************************/
 
 #include "DkSkewEstimator.h"
+#include "DkTransformUtils.h"
 #include "DkImageStorage.h"
 
 #include <QDebug>
+#include <QFuture>
+#include <QtConcurrentRun>
+
+#include <stdint.h>
+#include <algorithm>
 
 namespace nmp {
 
-DkSkewEstimator::DkSkewEstimator(QWidget* mainWin) {
+namespace {
+
+// share of each step in the progress (per direction)
+const int progressSeparability = 300;
+const int progressEdgeMap = 50;
+const int progressWeights = 150;
+
+const double maxSkew = 30.0;			// largest angle searched (degree)
+const int coarsePixels = 2000000;		// the pyramid is reduced to levels below 2 MP
+const double refineWindow = 1.0;		// search window (+/- degree) of the first finer level
+const double minRefineWindow = 0.25;	// the window is halved on each level but not below
+
+inline bool isAborted(const QAtomicInt* abort) {
+	return abort && abort->load();
+}
+
+inline void addProgress(QAtomicInt* progress, int share, int done, int total) {
+	if (progress && total > 0)
+		progress->fetchAndAddRelaxed(share * done / total);
+}
+
+/**
+* Calls f(rowStart, rowEnd) for bands of the rows [rowStart rowEnd) in parallel.
+* There are about four bands per thread, bands are skipped once abort is set.
+**/
+template <typename Func>
+void processRows(int rowStart, int rowEnd, const QAtomicInt* abort, Func f) {
+
+	int rows = rowEnd - rowStart;
+	if (rows <= 0)
+		return;
+
+	int nb = qMax(qMin(cv::getNumThreads() * 4, rows), 1);
+
+	cv::parallel_for_(cv::Range(0, nb), [&](const cv::Range& range) {
+
+		for (int bIdx = range.start; bIdx < range.end; bIdx++) {
+
+			if (isAborted(abort))
+				return;
+
+			f(rowStart + rows * bIdx / nb, rowStart + rows * (bIdx + 1) / nb);
+		}
+	});
+}
+
+/**
+* The two boxes of the separability filter relative to the center pixel.
+* Each box covers the integral rows [r0 r1) and columns [c0 c1).
+**/
+struct SepBoxes {
+	int rA0, rA1, cA0, cA1;
+	int rB0, rB1, cB0, cB1;
+	double area;			// normalization of both boxes
+};
+
+/**
+* Integral images of 8 bit images with 32 bit sums.
+* The sums are stored modulo 2^32 - box sums are exact if they fit into 32 bit.
+* The squared sums are stored as TQ (uint32_t or double).
+**/
+template <typename TQ>
+void compactIntegrals(const cv::Mat& gray, cv::Mat& integral, cv::Mat& integralSq) {
+
+	for (int r = 0; r < gray.rows; r++) {
+
+		const uchar* g = gray.ptr<uchar>(r);
+		const uint32_t* sPrev = integral.ptr<uint32_t>(r);
+		uint32_t* s = integral.ptr<uint32_t>(r + 1);
+		const TQ* qPrev = integralSq.ptr<TQ>(r);
+		TQ* q = integralSq.ptr<TQ>(r + 1);
+
+		uint32_t rowSum = 0;
+		TQ rowSq = 0;
+
+		for (int c = 0; c < gray.cols; c++) {
+			rowSum += g[c];
+			rowSq += (TQ)(g[c] * g[c]);
+			s[c + 1] = sPrev[c + 1] + rowSum;
+			q[c + 1] = qPrev[c + 1] + rowSq;
+		}
+	}
+}
+
+template <typename T>
+inline T boxSum(const T* p0, const T* p1, int c0, int c1, int c) {
+	return (T)(p1[c + c1] - p1[c + c0] - p0[c + c1] + p0[c + c0]);
+}
+
+/**
+* Separability from the box sums s and squared sums q with the normalization n:
+* (m1 - m2)^2 / (v1 + v2) = (s1 - s2)^2 / ((q1 + q2) * n - s1^2 - s2^2)
+* All terms are integers below 2^53 for 8 bit images, so they are exact in double.
+**/
+inline float separabilityValue(double s1, double s2, double q1, double q2, double n) {
+
+	double d = s1 - s2;
+	return (float)(d * d / ((q1 + q2) * n - (s1 * s1 + s2 * s2)));
+}
+
+#ifdef DK_TRANSFORM_SSE2
+inline __m128i boxSum4(const uint32_t* p0, const uint32_t* p1, int c0, int c1, int c) {
+
+	__m128i v = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(p1 + c + c1)), _mm_loadu_si128((const __m128i*)(p1 + c + c0)));
+	v = _mm_sub_epi32(v, _mm_loadu_si128((const __m128i*)(p0 + c + c1)));
+	return _mm_add_epi32(v, _mm_loadu_si128((const __m128i*)(p0 + c + c0)));
+}
+
+// unsigned 32 bit to double
+inline void toDouble(__m128i v, __m128d& lo, __m128d& hi) {
+
+	const __m128d offset = _mm_set1_pd(2147483648.0);
+	v = _mm_xor_si128(v, _mm_set1_epi32((int)0x80000000));
+	lo = _mm_add_pd(_mm_cvtepi32_pd(v), offset);
+	hi = _mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(v, 8)), offset);
+}
+
+inline __m128d separabilityValue(__m128d s1, __m128d s2, __m128d q1, __m128d q2, __m128d n) {
+
+	__m128d d = _mm_sub_pd(s1, s2);
+	__m128d den = _mm_sub_pd(_mm_mul_pd(_mm_add_pd(q1, q2), n), _mm_add_pd(_mm_mul_pd(s1, s1), _mm_mul_pd(s2, s2)));
+	return _mm_div_pd(_mm_mul_pd(d, d), den);
+}
+
+/**
+* Computes four columns at once if sums and squared sums are 32 bit.
+* @return the first column that is not computed
+**/
+inline int separabilitySimd(const uint32_t* const* s, const uint32_t* const* q, const SepBoxes& b, float* dst, int colStart, int colEnd) {
+
+	const __m128d n = _mm_set1_pd(b.area);
+	int c = colStart;
+
+	for (; c + 4 <= colEnd; c += 4) {
+
+		__m128d s1lo, s1hi, s2lo, s2hi, q1lo, q1hi, q2lo, q2hi;
+		toDouble(boxSum4(s[0], s[1], b.cA0, b.cA1, c), s1lo, s1hi);
+		toDouble(boxSum4(s[2], s[3], b.cB0, b.cB1, c), s2lo, s2hi);
+		toDouble(boxSum4(q[0], q[1], b.cA0, b.cA1, c), q1lo, q1hi);
+		toDouble(boxSum4(q[2], q[3], b.cB0, b.cB1, c), q2lo, q2hi);
+
+		__m128 lo = _mm_cvtpd_ps(separabilityValue(s1lo, s2lo, q1lo, q2lo, n));
+		__m128 hi = _mm_cvtpd_ps(separabilityValue(s1hi, s2hi, q1hi, q2hi, n));
+		_mm_storeu_ps(dst + c, _mm_movelh_ps(lo, hi));
+	}
+
+	return c;
+}
+#endif
+
+template <typename TS, typename TQ>
+inline int separabilitySimd(const TS* const*, const TQ* const*, const SepBoxes&, float*, int colStart, int) {
+	return colStart;
+}
+
+/**
+* Computes the separability of the rows [rowStart rowEnd) and columns [colStart colEnd).
+* The same kernel is used for both directions - only the boxes differ.
+**/
+template <typename TS, typename TQ>
+void separabilityRows(const cv::Mat& integral, const cv::Mat& integralSq, const SepBoxes& b, cv::Mat& separability, int rowStart, int rowEnd, int colStart, int colEnd) {
+
+	for (int r = rowStart; r < rowEnd; r++) {
 
-	this->mainWin = mainWin;
+		// rows of the box corners: A top, A bottom, B top, B bottom
+		const TS* s[4] = {integral.ptr<TS>(r + b.rA0), integral.ptr<TS>(r + b.rA1), integral.ptr<TS>(r + b.rB0), integral.ptr<TS>(r + b.rB1)};
+		const TQ* q[4] = {integralSq.ptr<TQ>(r + b.rA0), integralSq.ptr<TQ>(r + b.rA1), integralSq.ptr<TQ>(r + b.rB0), integralSq.ptr<TQ>(r + b.rB1)};
+		float* dst = separability.ptr<float>(r);
+
+		int c = separabilitySimd(s, q, b, dst, colStart, colEnd);
+
+		for (; c < colEnd; c++) {
+
+			dst[c] = separabilityValue(
+				(double)boxSum(s[0], s[1], b.cA0, b.cA1, c),
+				(double)boxSum(s[2], s[3], b.cB0, b.cB1, c),
+				(double)boxSum(q[0], q[1], b.cA0, b.cA1, c),
+				(double)boxSum(q[2], q[3], b.cB0, b.cB1, c),
+				b.area);
+		}
+	}
+}
+
+};
+
+DkSkewEstimator::DkSkewEstimator() {
 
 	// method parameters
 	nIter = 200;
@@ -47,6 +236,13 @@ DkSkewEstimator::DkSkewEstimator(QWidget* mainWin) {
 	minLineLength = 10;
 	minLineProjLength = minLineLength/4;
 	rotationFactor = 1;
+	intMode = integral_compact;
+	sMode = search_pyramid;
+
+	levelShare = progress_end;
+	minAngle = -maxSkew;
+	maxAngle = maxSkew;
+	angleStep = 0.1;
 
 	selectedLines.clear();
 }
@@ -58,163 +254,295 @@ DkSkewEstimator::~DkSkewEstimator() {
 void DkSkewEstimator::setImage(QImage inImage) {
 
 	matImg = nmc::DkImage::qImage2Mat(inImage);
-	
-	sepDims = QSize(qRound(inImage.width()/1430.0*49.0),qRound(inImage.height()/700.0*12.0));
-	delta = qRound(inImage.width()/1430.0*20.0);
-	minLineLength = qRound(inImage.width()/1430.0 * 20.0);
+	imgSize = inImage.size();
 	rotationFactor = 1;
 
 	if (inImage.width() < inImage.height()) {
-
 		matImg = matImg.t();
-		sepDims = QSize(qRound(inImage.width()/1430.0*49.0),qRound(inImage.height()/700.0*12.0));
-		delta = qRound(inImage.height()/1430.0*20.0);
-		minLineLength = qRound(inImage.height()/1430.0 * 20.0);
 		rotationFactor = -1;
 	}
 
+	updateParameters(1.0);
+}
+
+/**
+* Scales the size dependent parameters to a pyramid level.
+* @param scale the size of the level relative to the image
+**/
+void DkSkewEstimator::updateParameters(double scale) {
+
+	double width = imgSize.width() * scale;
+	double height = imgSize.height() * scale;
+	double longSide = qMax(width, height);
+
+	sepDims = QSize(qRound(width/1430.0*49.0),qRound(height/700.0*12.0));
+	delta = qRound(longSide/1430.0*20.0);
+	minLineLength = qRound(longSide/1430.0 * 20.0);
+
 	if (sepDims.width() < 1) sepDims.setWidth(1);
 	if (sepDims.height() < 1) sepDims.setHeight(1);
 
 	minLineProjLength = minLineLength/4;
 }
 
-double DkSkewEstimator::getSkewAngle() {
+/**
+* Selects if all angles are searched on the full resolution (search_full)
+* or coarse to fine on an image pyramid (search_pyramid).
+**/
+void DkSkewEstimator::setSearchMode(int mode) {
 
-	if (!matImg.empty()) {
-		progress = new QProgressDialog(QT_TRANSLATE_NOOP("nmc::DkSkewEstimator", "Calculating angle..."), QT_TRANSLATE_NOOP("nmc::DkSkewEstimator", "Cancel"), 0, 100, mainWin);
-		progress->setMinimumDuration(250);
-		progress->setMaximum(100);
-		progress->setValue(0);
-		progress->setWindowModality(Qt::WindowModal);
-		progress->setModal(true);
-		progress->hide();
-		progress->show();
+	if (mode >= 0 && mode < search_end)
+		sMode = mode;
+}
 
-		cv::Mat matGray;
+int DkSkewEstimator::searchMode() const {
+	return sMode;
+}
 
-		if (matImg.channels() > 1)
-			cv::cvtColor(matImg, matGray, CV_BGR2GRAY);
-		else matGray = matImg;
+/**
+* Returns the part of a progress share that belongs to the current level.
+**/
+int DkSkewEstimator::progressShare(int share) const {
+	return share * levelShare / progress_end;
+}
 
-		cv::Mat integral, integralSq;
-		cv::integral(matGray, integral, integralSq, CV_64F);
-		if (integral.channels() > 1) qDebug() << "Error! integral image has more than one channel";
+/**
+* Returns true if the angle of a line (in radians) can contribute to the current search window.
+**/
+bool DkSkewEstimator::inSearchWindow(double lineAngle) const {
 
-		cv::Mat separabilityHor = computeSeparability(integral, integralSq, dir_horizontal);
-		if (progress->wasCanceled()) {
-			progress->deleteLater();
-			return 0;
-		}
+	// all lines are kept (and displayed) if all angles are searched
+	if (minAngle <= -maxSkew && maxAngle >= maxSkew)
+		return true;
 
-		cv::Mat separabilityVer = computeSeparability(integral, integralSq,  dir_vertical);
-		if (progress->wasCanceled()) {
-			progress->deleteLater();
-			return 0;
-		}
+	// beyond 3 sigma the saliency is negligible
+	double angle = lineAngle / CV_PI * 180;
+	return angle >= minAngle - 3*sigma && angle <= maxAngle + 3*sigma;
+}
 
-		double min, max;
-		cv::minMaxLoc(separabilityHor, &min, &max);	
-		cv::Mat edgeMapHor = computeEdgeMap(separabilityHor, sepThr * max, dir_horizontal);
-		//cv::Mat edgeMapHor = computeEdgeMap(separabilityHor, 0.1, dir_horizontal);
-		if (progress->wasCanceled()) {
-			progress->deleteLater();
-			return 0;
-		}
+/**
+* Estimates the skew angle of the image.
+* The horizontal and vertical edges are processed concurrently.
+* In pyramid mode, the image is halved until it has less than coarsePixels pixels.
+* All angles are searched on the coarsest level, the finer levels only refine it.
+* @param progress is increased up to progress_end
+* @param abort stops the estimation early if it is set (0 is returned)
+* @return the skew angle in degree
+**/
+double DkSkewEstimator::getSkewAngle(QAtomicInt* progress, const QAtomicInt* abort) {
 
-		cv::minMaxLoc(separabilityVer, &min, &max);
-		cv::Mat edgeMapVer = computeEdgeMap(separabilityVer, sepThr * max, dir_vertical);
-		//cv::Mat edgeMapVer = computeEdgeMap(separabilityVer, 0.1, dir_vertical);
-		if (progress->wasCanceled()) {
-			progress->deleteLater();
-			return 0;
+	selectedLines.clear();
+	selectedLineTypes.clear();
+
+	if (matImg.empty())
+		return 0;
+
+	cv::Mat matGray;
+
+	if (matImg.channels() > 1)
+		cv::cvtColor(matImg, matGray, CV_BGR2GRAY);
+	else matGray = matImg;
+
+	// levels[0] is the full resolution
+	QVector<cv::Mat> levels;
+	levels << matGray;
+	double nPixels = (double)matGray.total();
+
+	while (sMode == search_pyramid && levels.last().total() > (size_t)coarsePixels && levels.last().rows > 1) {
+
+		cv::Mat level;
+		cv::resize(levels.last(), level, cv::Size(levels.last().cols/2, levels.last().rows/2), 0, 0, cv::INTER_AREA);
+		levels << level;
+		nPixels += (double)level.total();
+	}
+
+	double angle = 0;
+	double window = refineWindow;
+	minAngle = -maxSkew;
+	maxAngle = maxSkew;
+	angleStep = 0.1;
+
+	for (int idx = levels.size()-1; idx >= 0; idx--) {
+
+		const cv::Mat& level = levels[idx];
+
+		if (idx < levels.size()-1) {
+			minAngle = qMax(angle - window, -maxSkew);
+			maxAngle = qMin(angle + window, maxSkew);
+			angleStep = (idx == 0) ? 0.01 : 0.05;
+			window = qMax(window * 0.5, minRefineWindow);
 		}
 
-		selectedLines.clear();
+		updateParameters((double)level.cols / matGray.cols);
+		levelShare = qRound(progress_end * level.total() / nPixels);
+		angle = estimateLevel(level, angle, progress, abort);
 
-		QVector<QVector3D> weightsHor = computeWeights(edgeMapHor, dir_horizontal);
-		qDebug() << weightsHor.size();
-		QVector<QVector3D> weightsVer = computeWeights(edgeMapVer, dir_vertical);
-		qDebug() << weightsVer.size();
-		if (progress->wasCanceled()) {
-			selectedLines.clear();
-			progress->deleteLater();
+		if (isAborted(abort))
 			return 0;
-		}
+	}
 
-		weightsHor += weightsVer;
- 
-		double retAngle = computeSkewAngle(weightsHor, qSqrt(matGray.rows*matGray.rows + matGray.cols*matGray.cols));
+	if (progress)
+		progress->store(progress_end);
 
-		progress->setValue(100);
-		progress->deleteLater();
+	return angle;
+}
 
-		return retAngle;
-	}
-	else return 0;
+/**
+* Estimates the skew angle of one pyramid level within the current search window.
+* @param defaultAngle is returned if no line supports an angle of the window
+**/
+double DkSkewEstimator::estimateLevel(const cv::Mat& gray, double defaultAngle, QAtomicInt* progress, const QAtomicInt* abort) {
+
+	cv::Mat integral, integralSq;
+	computeIntegrals(gray, integral, integralSq);
+
+	QVector<QVector4D> linesVer;
+	QVector<QVector3D> weightsVer;
+
+	QFuture<void> verFuture = QtConcurrent::run([&]() {
+		weightsVer = computeDirection(integral, integralSq, dir_vertical, linesVer, progress, abort);
+	});
+
+	QVector<QVector4D> linesHor;
+	QVector<QVector3D> weightsHor = computeDirection(integral, integralSq, dir_horizontal, linesHor, progress, abort);
+	verFuture.waitForFinished();
+
+	if (isAborted(abort))
+		return 0;
+
+	// horizontal lines first - as before
+	weightsHor += weightsVer;
+	selectedLines = linesHor + linesVer;
+	selectedLineTypes.fill(0, selectedLines.size());
+
+	return computeSkewAngle(weightsHor, qSqrt(gray.rows*gray.rows + gray.cols*gray.cols), defaultAngle);
 }
 
-cv::Mat DkSkewEstimator::computeSeparability(cv::Mat integral, cv::Mat integralSq, int direction) {
+/**
+* Computes the weights and lines of one direction.
+**/
+QVector<QVector3D> DkSkewEstimator::computeDirection(const cv::Mat& integral, const cv::Mat& integralSq, int direction, QVector<QVector4D>& lines, QAtomicInt* progress, const QAtomicInt* abort) const {
 
-	cv::Mat separability = cv::Mat::zeros(integral.rows, integral.cols, CV_32FC1);
+	cv::Mat separability = computeSeparability(integral, integralSq, direction, progress, abort);
+	if (isAborted(abort))
+		return QVector<QVector3D>();
 
-	int W2 = qCeil(sepDims.width()/2);
-	int H2 = qCeil(sepDims.height()/2);
+	double min, max;
+	cv::minMaxLoc(separability, &min, &max);	
+	cv::Mat edgeMap = computeEdgeMap(separability, sepThr * max, direction, progress, abort);
+	if (isAborted(abort))
+		return QVector<QVector3D>();
 
-	if (direction == dir_horizontal) {
-		int progressStep = integral.rows - 2 * H2 - 2 * qCeil(delta/2);
-		int lastValue = progress->value();
+	return computeWeights(edgeMap, direction, lines, progress, abort);
+}
 
-		for (int r = H2 + qCeil(delta/2); r < integral.rows - H2 - qCeil(delta/2); r++) {
-			progress->setValue(lastValue + qRound(30.0 * (r - H2 - qCeil(delta/2)) / (double)progressStep));
-			if (progress->wasCanceled()) break;
-			for (int c = W2 + qCeil(delta/2); c < integral.cols - W2 - qCeil(delta/2); c++) {
+/**
+* Sets how the integral images are stored.
+* integral_compact halves the memory bandwidth for 8 bit images, integral_double is the reference.
+**/
+void DkSkewEstimator::setIntegralMode(int mode) {
 
-				double mean1 = integral.at<double>(r - H2, c - W2) + integral.at<double>(r - 1, c + W2) - integral.at<double>(r - H2, c + W2) - integral.at<double>(r - 1, c - W2);
-				double mean2 = integral.at<double>(r + 1, c - W2) + integral.at<double>(r + H2, c + W2) - integral.at<double>(r + 1, c + W2) - integral.at<double>(r + H2, c - W2);
-				mean1 /= (2 * W2 * H2);
-				mean2 /= (2 * W2 * H2);
+	if (mode >= 0 && mode < integral_end)
+		intMode = mode;
+}
 
-				double var1 = integralSq.at<double>(r - H2, c - W2) + integralSq.at<double>(r - 1, c + W2) - integralSq.at<double>(r - H2, c + W2) - integralSq.at<double>(r - 1, c - W2);
-				double var2 = integralSq.at<double>(r + 1, c - W2) + integralSq.at<double>(r + H2, c + W2) - integralSq.at<double>(r + 1, c + W2) - integralSq.at<double>(r + H2, c - W2);
-				var1 /= (2 * W2 * H2);
-				var2 /= (2 * W2 * H2);
+int DkSkewEstimator::integralMode() const {
+	return intMode;
+}
 
-				var1 = var1 - (mean1 * mean1);
-				var2 = var2 - (mean2 * mean2);
+/**
+* Computes the separability of the current image in the given direction.
+**/
+cv::Mat DkSkewEstimator::separability(int direction) const {
 
-				separability.at<float>(r, c) = (float)((mean1 - mean2) * (mean1 - mean2) / (var1 + var2));
-			}
-		}
+	if (matImg.empty())
+		return cv::Mat();
+
+	cv::Mat matGray;
+
+	if (matImg.channels() > 1)
+		cv::cvtColor(matImg, matGray, CV_BGR2GRAY);
+	else matGray = matImg;
+
+	cv::Mat integral, integralSq;
+	computeIntegrals(matGray, integral, integralSq);
+
+	return computeSeparability(integral, integralSq, direction, 0, 0);
+}
+
+/**
+* Computes the integral image and the integral image of squared values.
+* In compact mode, the sums of 8 bit images are stored as 32 bit integers. The squared
+* sums are 32 bit integers too if the largest box fits - otherwise they are doubles.
+**/
+void DkSkewEstimator::computeIntegrals(const cv::Mat& gray, cv::Mat& integral, cv::Mat& integralSq) const {
+
+	if (intMode == integral_compact && gray.type() == CV_8UC1) {
+
+		double boxArea = 2.0 * qCeil(sepDims.width()/2) * qCeil(sepDims.height()/2);
+		bool sq32 = boxArea * 255 * 255 < 4294967296.0;
+
+		integral = cv::Mat::zeros(gray.rows + 1, gray.cols + 1, CV_32SC1);
+		integralSq = cv::Mat::zeros(gray.rows + 1, gray.cols + 1, sq32 ? CV_32SC1 : CV_64FC1);
+
+		if (sq32)
+			compactIntegrals<uint32_t>(gray, integral, integralSq);
+		else
+			compactIntegrals<double>(gray, integral, integralSq);
 	}
-	else {
-		int progressStep = integral.rows - 2 * W2 - 2 * qCeil(delta/2);
-		int lastValue = progress->value();
+	else
+		cv::integral(gray, integral, integralSq, CV_64F);
+}
 
-		for (int r = W2 + qCeil(delta/2); r < integral.rows - W2 - qCeil(delta/2); r++) {
-			progress->setValue(lastValue + qRound(30.0 * (r - W2 - qCeil(delta/2)) / (double)progressStep));
-			if (progress->wasCanceled()) break;
+cv::Mat DkSkewEstimator::computeSeparability(const cv::Mat& integral, const cv::Mat& integralSq, int direction, QAtomicInt* progress, const QAtomicInt* abort) const {
 
-			for (int c = H2 + qCeil(delta/2); c < integral.cols - H2 - qCeil(delta/2); c++) {
+	cv::Mat separability = cv::Mat::zeros(integral.rows, integral.cols, CV_32FC1);
 
-				double mean1 = integral.at<double>(r - W2, c - H2) + integral.at<double>(r + W2, c - 1) - integral.at<double>(r + W2, c - H2) - integral.at<double>(r - W2, c - 1);
-				double mean2 = integral.at<double>(r - W2, c + 1) + integral.at<double>(r + W2, c + H2) - integral.at<double>(r + W2, c + 1) - integral.at<double>(r - W2, c + H2);
-				mean1 /= (2 * W2 * H2);
-				mean2 /= (2 * W2 * H2);
+	int W2 = qCeil(sepDims.width()/2);
+	int H2 = qCeil(sepDims.height()/2);
 
-				double var1 = integralSq.at<double>(r - W2, c - H2) + integralSq.at<double>(r + W2, c - 1) - integralSq.at<double>(r + W2, c - H2) - integralSq.at<double>(r - W2, c - 1);
-				double var2 = integralSq.at<double>(r - W2, c + 1) + integralSq.at<double>(r + W2, c + H2) - integralSq.at<double>(r + W2, c + 1) - integralSq.at<double>(r - W2, c + H2);
-				var1 /= (2 * W2 * H2);
-				var2 /= (2 * W2 * H2);
+	// the boxes are empty for tiny images
+	if (W2 < 1 || H2 < 1) {
+		addProgress(progress, progressShare(progressSeparability), 1, 1);
+		return separability;
+	}
 
-				var1 = var1 - (mean1 * mean1);
-				var2 = var2 - (mean2 * mean2);
+	SepBoxes b;
+	b.area = 2.0 * W2 * H2;
 
-				separability.at<float>(r, c) = (float)((mean1 - mean2) * (mean1 - mean2) / (var1 + var2));
-			}
-		}
+	// horizontal: boxes above and below the pixel, vertical: left and right of it
+	if (direction == dir_horizontal) {
+		b.rA0 = -H2;	b.rA1 = -1;		b.cA0 = -W2;	b.cA1 = W2;
+		b.rB0 = 1;		b.rB1 = H2;		b.cB0 = -W2;	b.cB1 = W2;
+	}
+	else {
+		b.rA0 = -W2;	b.rA1 = W2;		b.cA0 = -H2;	b.cA1 = -1;
+		b.rB0 = -W2;	b.rB1 = W2;		b.cB0 = 1;		b.cB1 = H2;
 	}
 
+	int rowBorder = ((direction == dir_horizontal) ? H2 : W2) + qCeil(delta/2);
+	int colBorder = ((direction == dir_horizontal) ? W2 : H2) + qCeil(delta/2);
+	int rowStart = rowBorder;
+	int rowEnd = integral.rows - rowBorder;
+	int colStart = colBorder;
+	int colEnd = integral.cols - colBorder;
+
+	bool sum32 = integral.depth() == CV_32S;
+	bool sq32 = integralSq.depth() == CV_32S;
+
+	// the rows are independent - split them into bands
+	processRows(rowStart, rowEnd, abort, [&](int bandStart, int bandEnd) {
+
+		if (sum32 && sq32)
+			separabilityRows<uint32_t, uint32_t>(integral, integralSq, b, separability, bandStart, bandEnd, colStart, colEnd);
+		else if (sum32)
+			separabilityRows<uint32_t, double>(integral, integralSq, b, separability, bandStart, bandEnd, colStart, colEnd);
+		else
+			separabilityRows<double, double>(integral, integralSq, b, separability, bandStart, bandEnd, colStart, colEnd);
+
+		addProgress(progress, progressShare(progressSeparability), bandEnd - bandStart, rowEnd - rowStart);
+	});
+
 	// for displaying:
 	// cv::normalize(separability, separability, 0, 255, NORM_MINMAX, CV_8UC1);
 	// cvtColor(separability, separability, CV_GRAY2RGB);
@@ -222,9 +550,7 @@ cv::Mat DkSkewEstimator::computeSeparability(cv::Mat integral, cv::Mat integralS
 	return separability;
 }
 
-cv::Mat DkSkewEstimator::computeEdgeMap(cv::Mat separability, double thr, int direction) {
-
-	int tmpStatus;
+cv::Mat DkSkewEstimator::computeEdgeMap(const cv::Mat& separability, double thr, int direction, QAtomicInt* progress, const QAtomicInt* abort) const {
 
 	int W2 = qCeil(sepDims.width()/2);
 	int H2 = qCeil(sepDims.height()/2);
@@ -232,233 +558,237 @@ cv::Mat DkSkewEstimator::computeEdgeMap(cv::Mat separability, double thr, int di
 	cv::Mat edgeMap = cv::Mat::zeros(separability.rows, separability.cols, CV_8UC1);
 
 	if (direction == dir_horizontal) {
-		int progressStep = separability.rows - 2 * H2 - 2 * kMax;
-		int lastValue = progress->value();
-
-		float* p;
-		for (int r = H2 + kMax; r < separability.rows - H2 - kMax; r++) {
-			progress->setValue(lastValue + qRound(5.0 * (r - H2 - kMax) / (double)progressStep));
-			if (progress->wasCanceled()) break;
-
-			p = separability.ptr<float>(r);
-			for (int c = W2; c < separability.cols - W2; c++) {
-
-				if (p[c] > thr) {
-					tmpStatus = 1;
-					for (int k = -kMax; k <= kMax; k++) {
-						if (k==0) k++;
-						float* pK;
-						pK = separability.ptr<float>(r + k);
-						if (pK[c] > p[c]) {
-							tmpStatus = 0;
-							break;
+
+		int rowStart = H2 + kMax;
+		int rowEnd = separability.rows - H2 - kMax;
+
+		processRows(rowStart, rowEnd, abort, [&](int bandStart, int bandEnd) {
+
+			for (int r = bandStart; r < bandEnd; r++) {
+
+				const float* p = separability.ptr<float>(r);
+				for (int c = W2; c < separability.cols - W2; c++) {
+
+					if (p[c] > thr) {
+						int tmpStatus = 1;
+						for (int k = -kMax; k <= kMax; k++) {
+							if (k==0) k++;
+							const float* pK = separability.ptr<float>(r + k);
+							if (pK[c] > p[c]) {
+								tmpStatus = 0;
+								break;
+							}
 						}
-					}
 
-					if(tmpStatus) {
-						uchar* pEM;
-						pEM = edgeMap.ptr<uchar>(r);
-						pEM[c] = 1;
+						if(tmpStatus) {
+							uchar* pEM = edgeMap.ptr<uchar>(r);
+							pEM[c] = 1;
+						}
 					}
 				}
 			}
-		}
+
+			addProgress(progress, progressShare(progressEdgeMap), bandEnd - bandStart, rowEnd - rowStart);
+		});
 	}
 	else  {
-		int progressStep = separability.rows - 2 * W2 - 2 * kMax;
-		int lastValue = progress->value();
-
-		float* p;
-		for (int r = W2; r < separability.rows - W2; r++) {
-			progress->setValue(lastValue + qRound(5.0 * (r - W2 - kMax) / (double)progressStep));
-			if (progress->wasCanceled()) break;
-
-			p = separability.ptr<float>(r);
-			for (int c = H2 + kMax; c < separability.cols - H2 - kMax; c++) {
-
-				if (p[c] > thr) {
-					tmpStatus = 1;
-					for (int k = -kMax; k <= kMax; k++) {
-						if (k==0) k++;
-						if (p[c+k] > p[c]) {
-							tmpStatus = 0;
-							break;
+
+		int rowStart = W2;
+		int rowEnd = separability.rows - W2;
+
+		processRows(rowStart, rowEnd, abort, [&](int bandStart, int bandEnd) {
+
+			for (int r = bandStart; r < bandEnd; r++) {
+
+				const float* p = separability.ptr<float>(r);
+				for (int c = H2 + kMax; c < separability.cols - H2 - kMax; c++) {
+
+					if (p[c] > thr) {
+						int tmpStatus = 1;
+						for (int k = -kMax; k <= kMax; k++) {
+							if (k==0) k++;
+							if (p[c+k] > p[c]) {
+								tmpStatus = 0;
+								break;
+							}
 						}
-					}
 
-					if(tmpStatus) {
-						uchar* pEM;
-						pEM = edgeMap.ptr<uchar>(r);
-						pEM[c] = 1;
+						if(tmpStatus) {
+							uchar* pEM = edgeMap.ptr<uchar>(r);
+							pEM[c] = 1;
+						}
 					}
 				}
 			}
-		}
+
+			addProgress(progress, progressShare(progressEdgeMap), bandEnd - bandStart, rowEnd - rowStart);
+		});
 	}
 
 	return edgeMap;
 }
 
-int DkSkewEstimator::randInt(int low, int high) {
+/**
+* Fits lines to the edge map and weights them by their support.
+* The Hough segments are voted concurrently, the weights keep the order of the segments.
+* @param lines returns the best fitting segment of each weight
+**/
+QVector<QVector3D> DkSkewEstimator::computeWeights(const cv::Mat& edgeMap, int direction, QVector<QVector4D>& lines, QAtomicInt* progress, const QAtomicInt* abort) const {
 
-	return qrand() % ((high + 1) - low) + low;
-}
+	std::vector<cv::Vec4i> houghLines;
+	HoughLinesP(edgeMap, houghLines, 1, CV_PI/180, 50, minLineLength, 20 ); //params: rho resolution, theta resolution, threshold, min Line length, max line gap
 
-QVector<QVector3D> DkSkewEstimator::computeWeights(cv::Mat edgeMap, int direction) {
+	int nLines = (int)houghLines.size();
+	int share = progressShare(progressWeights);
 
-	std::vector<cv::Vec4i> lines;
-	QVector4D maxLine = QVector4D();
-	HoughLinesP(edgeMap, lines, 1, CV_PI/180, 50, minLineLength, 20 ); //params: rho resolution, theta resolution, threshold, min Line length, max line gap
+	// x = 0 if a segment has no support
+	std::vector<QVector3D> lineWeights(nLines, QVector3D(0.0, 0.0, 0.0));
+	std::vector<QVector4D> maxLines(nLines);
+
+	cv::parallel_for_(cv::Range(0, nLines), [&](const cv::Range& range) {
+
+		// reused for all segments of the range
+		std::vector<int> votes;
+
+		for (int i = range.start; i < range.end; i++) {
+
+			if (isAborted(abort))
+				return;
+
+			// add the difference so that the shares sum up exactly
+			if (progress)
+				progress->fetchAndAddRelaxed(share * (i + 1) / nLines - share * i / nLines);
+
+			lineWeights[i] = voteLine(edgeMap, direction, houghLines[i], votes, maxLines[i]);
+		}
+	});
 
 	QVector<QVector3D> computedWeights = QVector<QVector3D>();
-	int lastValue = progress->value();
 
-	for(size_t i = 0; i < lines.size(); i++) {
-		progress->setValue(lastValue + qRound(15.0 * (float)i / lines.size()));
-		if (progress->wasCanceled()) break;
+	for (int i = 0; i < nLines; i++) {
 
-		cv::Vec4i l = lines[i];		
-		QVector3D currMax = QVector3D(0.0, 0.0, 0.0);
+		if (lineWeights[i].x() > 0) {
+			computedWeights.append(lineWeights[i]);
+			lines.append(maxLines[i]);
+		}
+	}
 
-		if (direction == dir_horizontal) {
+	if (!nLines)
+		addProgress(progress, progressShare(progressWeights), 1, 1);
 
-			int K = 0;
+	return computedWeights;
+}
 
-			if (l[2] < l[0]) l = cv::Vec4i(l[2],l[3],l[0],l[1]);
+/**
+* Finds the best supported part of a Hough segment.
+* The segment is shrunk from both ends as long as edges are found close to
+* its end points. Each part is scored by the edge pixels in a band of
+* +/- epsilon along the segment - these are prefix sums along the segment,
+* so every part is scored in O(1).
+* @param line the Hough segment
+* @param votes is a buffer for the prefix sums
+* @param maxLine returns the best part in image coordinates
+* @return the weight (support, angle, distance to the center) - support is 0 if nothing was found
+**/
+QVector3D DkSkewEstimator::voteLine(const cv::Mat& edgeMap, int direction, const cv::Vec4i& line, std::vector<int>& votes, QVector4D& maxLine) const {
+
+	bool horizontal = direction == dir_horizontal;
+
+	// coordinates along (a) and across (b) the direction
+	int alongSize = horizontal ? edgeMap.cols : edgeMap.rows;
+	int acrossSize = horizontal ? edgeMap.rows : edgeMap.cols;
+
+	int a0 = horizontal ? line[0] : line[1];
+	int b0 = horizontal ? line[1] : line[0];
+	int a1 = horizontal ? line[2] : line[3];
+	int b1 = horizontal ? line[3] : line[2];
+
+	if (a1 < a0) {
+		std::swap(a0, a1);
+		std::swap(b0, b1);
+	}
 
-			int x1 = l[0];
-			int x2 = l[2];
+	int x1 = qMax(a0, 0);
+	int x2 = qMin(a1, alongSize);
 
-			while(x2 > edgeMap.cols) x2--;
-			while(x1 < 0) x1--;
+	double lineAngle = atan2((double)(b1 - b0), (double)(a1 - a0));
+	double slope = qTan(lineAngle);
+	double weightAngle = horizontal ? -rotationFactor * lineAngle : rotationFactor * lineAngle;
 
-			double lineAngle =  atan2((l[3] - l[1]), (l[2] - l[0]));
-			double slope = qTan(lineAngle);
+	QVector3D currMax = QVector3D(0.0, 0.0, 0.0);
 
-			while (qAbs(x1-x2) > minLineProjLength && K < nIter) {
+	if (!inSearchWindow(weightAngle))
+		return currMax;
 
-				int y1 = qRound(l[1] + (x1 - l[0]) * slope);
-				int y2 = qRound(l[1] + (x2 - l[0]) * slope);
+	// edgeMap(a, b)
+	auto edge = [&](int a, int b) -> int {
+		return horizontal ? edgeMap.ptr<uchar>(b)[a] : edgeMap.ptr<uchar>(a)[b];
+	};
 
-				QVector<int> yrPoss1 = QVector<int>();
-				for (int di = -delta; di <= delta && y1 + di < edgeMap.rows; di++) {
-					if (y1 + di >= 0)
-						if (edgeMap.at<uchar>(y1 + di, x1) == 1) yrPoss1.append(y1+di);
-				}
-				
-				QVector<int> yrPoss2 = QVector<int>();
-				for (int di = -delta; di <= delta && y2 + di < edgeMap.rows; di++) {
-					if (y2 + di >= 0)
-						if (edgeMap.at<uchar>(y2 + di, x2) == 1) yrPoss2.append(y2+di);
-				}
+	// number of edge pixels within +/- delta at a
+	auto candidates = [&](int a, int b) -> int {
+		int n = 0;
+		for (int di = qMax(-delta, -b); di <= delta && b + di < acrossSize; di++)
+			n += edge(a, b + di) == 1;
+		return n;
+	};
 
-				if (yrPoss1.size() > 0 && yrPoss2.size() > 0) {
-					for (int y1i = 0; y1i < yrPoss1.size(); y1i++) {
-
-						int ys1 = yrPoss1.at(y1i);
-						for (int y2i = 0; y2i < yrPoss2.size(); y2i++) {
-							int ys2 = yrPoss2.at(y2i);
-
-							double sumVal = 0;
-							for (int xi = x1; xi <= x2; xi++)
-								for (int yi = -epsilon; yi <= epsilon; yi++) {
-									int yc = qRound(l[1] + (xi - l[0]) * slope) + yi;
-									if(yc < edgeMap.rows && xi < edgeMap.cols && yc > 0 && xi > 0) sumVal += edgeMap.at<uchar>(yc, xi);
-								}
-
-							if (sumVal > currMax.x()) {
-				
-								QPointF centerPoint = QPointF(0.5*(x1 + x2), 0.5*(y1 + y2));
-								currMax = QVector3D(sumVal, - rotationFactor * lineAngle, (float) qSqrt( (edgeMap.cols*0.5 - centerPoint.x()) * (edgeMap.cols*0.5 - centerPoint.x()) + (edgeMap.rows*0.5 - centerPoint.y()) * (edgeMap.rows*0.5 - centerPoint.y()) ));
-								maxLine = QVector4D(x1, y1, x2, y2);
-							}
+	// votes[k] is the band support of [x1, x1 + k)
+	votes.resize(qMax(x2 - x1 + 2, 1));
+	votes[0] = 0;
 
-							K++;
-						}
-					}
-				}
+	for (int xi = x1; xi <= x2; xi++) {
 
-				x1++;
-				x2--;				
-			}
+		int sum = 0;
+		int yLine = qRound(b0 + (xi - a0) * slope);
+
+		if (xi > 0 && xi < alongSize) {
+			for (int yc = qMax(yLine - epsilon, 1); yc <= yLine + epsilon && yc < acrossSize; yc++)
+				sum += edge(xi, yc);
 		}
-		else {
 
-			int K = 0;
-			if (l[3] < l[1]) l = cv::Vec4i(l[2],l[3],l[0],l[1]);
+		votes[xi - x1 + 1] = votes[xi - x1] + sum;
+	}
 
-			int x1 = l[1];
-			int x2 = l[3];
+	int xStart = x1;
+	int K = 0;
 
-			while(x2 > edgeMap.rows) x2--;
-			while(x1 < 0) x1--;
+	while (x2 - x1 > minLineProjLength && K < nIter) {
 
-			double lineAngle =  atan2((l[2] - l[0]), (l[3] - l[1]));
-			double slope = qTan(lineAngle);
-			
+		int y1 = qRound(b0 + (x1 - a0) * slope);
+		int y2 = qRound(b0 + (x2 - a0) * slope);
 
-			while (qAbs(x1-x2) > minLineProjLength && K < nIter) {
+		int n1 = candidates(x1, y1);
+		int n2 = n1 ? candidates(x2, y2) : 0;
 
-				int y1 = qRound(l[0] + (x1 - l[1]) * slope);
-				int y2 = qRound(l[0] + (x2 - l[1]) * slope);
+		if (n1 > 0 && n2 > 0) {
 
-				QVector<int> yrPoss1 = QVector<int>();
-				for (int di = -delta; di <= delta && y1 + di < edgeMap.cols; di++) {
-					if (y1 + di >= 0)
-						if (edgeMap.at<uchar>(x1, y1 + di) == 1) yrPoss1.append(y1+di);
-				}
-				
-				QVector<int> yrPoss2 = QVector<int>();
-				for (int di = -delta; di <= delta && y2 + di < edgeMap.cols; di++) {
-					if (y2 + di >= 0)
-						if (edgeMap.at<uchar>(x2, y2 + di) == 1) yrPoss2.append(y2+di);
-				}
+			// the band does not depend on the candidates - all pairs share the same support
+			int sumVal = votes[x2 - xStart + 1] - votes[x1 - xStart];
 
-				if (yrPoss1.size() > 0 && yrPoss2.size() > 0) {
-					for (int y1i = 0; y1i < yrPoss1.size(); y1i++) {
-
-						int ys1 = yrPoss1.at(y1i);
-						for (int y2i = 0; y2i < yrPoss2.size(); y2i++) {
-							int ys2 = yrPoss2.at(y2i);
-
-							double sumVal = 0;
-							for (int xi = x1; xi <= x2; xi++)
-								for (int yi = -epsilon; yi <= epsilon; yi++) {
-									int yc = qRound(l[0] + (xi - l[1]) * slope) + yi;
-									if(yc < edgeMap.cols && xi < edgeMap.rows && yc > 0 && xi > 0) sumVal += edgeMap.at<uchar>(xi, yc);
-								}
-
-							if (sumVal > currMax.x()) {
-				
-								QPointF centerPoint = QPointF(0.5*(x1 + x2), 0.5*(y1 + y2));
-								currMax = QVector3D(sumVal, rotationFactor * lineAngle, (float) qSqrt( (edgeMap.rows *0.5 - centerPoint.x()) * (edgeMap.rows*0.5 - centerPoint.x()) + (edgeMap.cols*0.5 - centerPoint.y()) * (edgeMap.cols*0.5 - centerPoint.y()) ));
-								maxLine = QVector4D(y1, x1, y2, x2);
-							}
+			if (sumVal > currMax.x()) {
 
-							K++;
-						}
-					}
-				}
-
-				x1++;
-				x2--;				
+				QPointF centerPoint = QPointF(0.5*(x1 + x2), 0.5*(y1 + y2));
+				currMax = QVector3D(sumVal, weightAngle, (float) qSqrt( (alongSize*0.5 - centerPoint.x()) * (alongSize*0.5 - centerPoint.x()) + (acrossSize*0.5 - centerPoint.y()) * (acrossSize*0.5 - centerPoint.y()) ));
+				maxLine = horizontal ? QVector4D(x1, y1, x2, y2) : QVector4D(y1, x1, y2, x2);
 			}
-		}
 
-		if (currMax.x() > 0) {
-			computedWeights.append(currMax);
-			if (rotationFactor == -1) maxLine = QVector4D(maxLine.y(), maxLine.x(), maxLine.w(), maxLine.z());
-			selectedLines.append(maxLine);
-			selectedLineTypes.append(0);
+			K += n1 * n2;
 		}
+
+		x1++;
+		x2--;
 	}
-	return computedWeights;
-}
 
+	if (currMax.x() > 0 && rotationFactor == -1)
+		maxLine = QVector4D(maxLine.y(), maxLine.x(), maxLine.w(), maxLine.z());
 
-double DkSkewEstimator::computeSkewAngle(QVector<QVector3D> weights, double imgDiagonal) {
+	return currMax;
+}
 
-	if (weights.size() < 1) return 0;
+double DkSkewEstimator::computeSkewAngle(QVector<QVector3D> weights, double imgDiagonal, double defaultAngle) {
+
+	if (weights.size() < 1) return defaultAngle;
 
 	double maxWeight = 0;
 	for (int i = 0; i < weights.size(); i++)
@@ -476,8 +806,11 @@ double DkSkewEstimator::computeSkewAngle(QVector<QVector3D> weights, double imgD
 
 	QVector<QPointF> saliencyVec = QVector<QPointF>();
 
-	for (double skewAngle = -30; skewAngle <= 30.001; skewAngle += 0.1) {
+	int nSteps = qRound((maxAngle - minAngle) / angleStep);
+
+	for (int sIdx = 0; sIdx <= nSteps; sIdx++) {
 
+		double skewAngle = minAngle + sIdx * angleStep;
 		double saliency = 0;
 
 		for (int i = 0; i < thrWeights.size(); i++) {
@@ -503,7 +836,7 @@ double DkSkewEstimator::computeSkewAngle(QVector<QVector3D> weights, double imgD
 		if (weights.at(i).x() > eta && qAbs(weights.at(i).y() / M_PI * 180 - salSkewAngle) < 0.15)
 			selectedLineTypes.replace(i,1);
 
-	if (maxSaliency == 0) return 0;
+	if (maxSaliency == 0) return defaultAngle;
 
 	return salSkewAngle;
 }
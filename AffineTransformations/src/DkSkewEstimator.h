@@ -33,8 +33,7 @@
 #include <QVector3D>
 #include <QVector4D>
 #include <cmath>
-#include <QProgressDialog>
-#include <QWidget>
+#include <QAtomicInt>
 #include <QDebug>
 
 // opencv
@@ -53,6 +52,14 @@
 namespace nmp {
 
 
+/**
+*	Estimates the skew of document images.
+*	getSkewAngle() does not touch any widgets so it can run in a background task.
+*	Both directions are processed concurrently, the progress is counted up to
+*	progress_end and the estimation stops early if abort is set.
+*	In pyramid mode, large images are first searched on a downsampled level
+*	and the angle is then refined in a narrow window on the finer levels.
+**/
 class DkSkewEstimator {
 
 public:
@@ -64,20 +71,51 @@ public:
 		dir_end,
 	};
 
-	DkSkewEstimator(QWidget* mainWin = 0);
+	enum {
+		progress_end = 1000,
+	};
+
+	enum {
+		integral_double = 0,	// 64 bit floating point sums (cv::integral)
+		integral_compact,		// 32 bit sums for 8 bit images
+
+		integral_end,
+	};
+
+	enum {
+		search_full = 0,		// all angles on the full resolution
+		search_pyramid,			// coarse to fine
+
+		search_end,
+	};
+
+	DkSkewEstimator();
 	~DkSkewEstimator();
 
-	double getSkewAngle();
+	double getSkewAngle(QAtomicInt* progress = 0, const QAtomicInt* abort = 0);
 	QVector<QVector4D> getLines();
 	QVector<int> getLineTypes();
 	void setImage(QImage inImage);
 
+	void setIntegralMode(int mode);
+	int integralMode() const;
+	cv::Mat separability(int direction) const;
+
+	void setSearchMode(int mode);
+	int searchMode() const;
+
 private: 
-	cv::Mat computeSeparability(cv::Mat integral, cv::Mat integralSq, int direction);
-	cv::Mat computeEdgeMap(cv::Mat separability, double thr, int direction);
-	QVector<QVector3D> computeWeights(cv::Mat edgeMap, int direction);
-	double computeSkewAngle(QVector<QVector3D> weights, double imgDiagonal);
-	int randInt(int low, int high);
+	double estimateLevel(const cv::Mat& gray, double defaultAngle, QAtomicInt* progress, const QAtomicInt* abort);
+	void updateParameters(double scale);
+	int progressShare(int share) const;
+	bool inSearchWindow(double lineAngle) const;
+	void computeIntegrals(const cv::Mat& gray, cv::Mat& integral, cv::Mat& integralSq) const;
+	QVector<QVector3D> computeDirection(const cv::Mat& integral, const cv::Mat& integralSq, int direction, QVector<QVector4D>& lines, QAtomicInt* progress, const QAtomicInt* abort) const;
+	cv::Mat computeSeparability(const cv::Mat& integral, const cv::Mat& integralSq, int direction, QAtomicInt* progress, const QAtomicInt* abort) const;
+	cv::Mat computeEdgeMap(const cv::Mat& separability, double thr, int direction, QAtomicInt* progress, const QAtomicInt* abort) const;
+	QVector<QVector3D> computeWeights(const cv::Mat& edgeMap, int direction, QVector<QVector4D>& lines, QAtomicInt* progress, const QAtomicInt* abort) const;
+	QVector3D voteLine(const cv::Mat& edgeMap, int direction, const cv::Vec4i& line, std::vector<int>& votes, QVector4D& maxLine) const;
+	double computeSkewAngle(QVector<QVector3D> weights, double imgDiagonal, double defaultAngle);
 
 	int nIter;
 	QSize sepDims;
@@ -92,9 +130,16 @@ private:
 	QVector<QVector4D> selectedLines;
 	QVector<int> selectedLineTypes;
 	cv::Mat matImg;
+	QSize imgSize;
 	int rotationFactor;
-	QProgressDialog* progress;
-	QWidget* mainWin;
+	int intMode;
+	int sMode;
+
+	// current pyramid level
+	int levelShare;			// progress of this level (of progress_end)
+	double minAngle;		// search window in degree
+	double maxAngle;
+	double angleStep;
 };
 
 };
@@ -0,0 +1,194 @@
+/*******************************************************************************************************
+ DkDeskewBatchPlugin.cpp
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkDeskewBatchPlugin.h"
+
+#include "DkSettings.h"
+#include "DkImageContainer.h"
+#include "DkSkewEstimator.h"
+
+#include <QUuid>
+
+namespace nmp {
+
+/**
+*	Constructor
+**/
+DkDeskewBatchPlugin::DkDeskewBatchPlugin() {
+
+	// create run IDs
+	QVector<QString> runIds;
+	runIds.resize(id_end);
+
+	for (int idx = 0; idx < id_end; idx++)
+		runIds[idx] = QUuid::createUuid().toString();
+	mRunIDs = runIds.toList();
+
+	// create menu actions
+	QVector<QString> menuNames;
+	menuNames.resize(id_end);
+
+	menuNames[id_deskew] = tr("Deskew");
+	mMenuNames = menuNames.toList();
+
+	// create menu status tips
+	QVector<QString> statusTips;
+	statusTips.resize(id_end);
+
+	statusTips[id_deskew] = tr("Estimates the skew angle and rotates the image with the last applied interpolation and crop settings.");
+	mMenuStatusTips = statusTips.toList();
+
+	// save default settings
+	loadSettings(nmc::DkSettingsManager::instance().qSettings());
+	saveSettings(nmc::DkSettingsManager::instance().qSettings());
+}
+
+/**
+* Returns unique ID for the generated dll
+**/
+QString DkDeskewBatchPlugin::id() const {
+	return PLUGIN_ID;
+};
+
+/**
+* Returns descriptive image
+**/
+QImage DkDeskewBatchPlugin::image() const {
+
+	return QImage(":/nomacsPluginDeskewBatch/img/description.png");
+}
+
+QString DkDeskewBatchPlugin::version() const {
+	return PLUGIN_VERSION;
+}
+
+QString DkDeskewBatchPlugin::name() const {
+	return "Deskew Batch";
+}
+
+QList<QAction*> DkDeskewBatchPlugin::createActions(QWidget* parent) {
+
+	if (mActions.empty()) {
+
+		for (int idx = 0; idx < id_end; idx++) {
+			QAction* ca = new QAction(mMenuNames[idx], parent);
+			ca->setObjectName(mMenuNames[idx]);
+			ca->setStatusTip(mMenuStatusTips[idx]);
+			ca->setData(mRunIDs[idx]);	// runID needed for calling function runPlugin()
+			mActions.append(ca);
+		}
+	}
+
+	return mActions;
+}
+
+QList<QAction*> DkDeskewBatchPlugin::pluginActions() const {
+
+	return mActions;
+}
+
+/**
+* Main function: deskews the image with the stored settings
+* @param plugin ID
+* @param image to be processed
+**/
+QSharedPointer<nmc::DkImageContainer> DkDeskewBatchPlugin::runPlugin(
+	const QString &runID,
+	QSharedPointer<nmc::DkImageContainer> imgC,
+	const nmc::DkSaveInfo&,
+	QSharedPointer<nmc::DkBatchInfo>&) const {
+
+	if (runID != mRunIDs[id_deskew] || !imgC)
+		return imgC;
+
+	QImage img = deskewImage(imgC->image());
+
+	if (img.isNull())
+		return QSharedPointer<nmc::DkImageContainer>();	// notify parent
+
+	imgC->setImage(img, tr("Deskewed"));
+
+	return imgC;
+}
+
+/**
+* Reloads the values the transformations toolbar stored since the plugin was created.
+**/
+void DkDeskewBatchPlugin::preLoadPlugin() const {
+
+	readSettings(nmc::DkSettingsManager::instance().qSettings());
+}
+
+/**
+* Estimates the skew of an image and rotates it back.
+* Estimator and warp are local, so the batch can process images concurrently.
+**/
+QImage DkDeskewBatchPlugin::deskewImage(const QImage& img) const {
+
+	if (img.isNull())
+		return img;
+
+	DkSkewEstimator estimator;
+	estimator.setImage(img);
+	double angle = estimator.getSkewAngle();
+
+	if (angle == 0)
+		return img;
+
+	QSize outSize = DkImageWarp::rotatedSize(img.size(), angle, mCrop);
+
+	DkImageWarp warp(img);
+	warp.setInterpolation(mInterpolation);
+	warp.setBackground(Qt::white);
+
+	return warp.warp(DkImageWarp::rotationTransform(img.size(), outSize, angle), outSize);
+}
+
+void DkDeskewBatchPlugin::loadSettings(QSettings & settings) {
+
+	readSettings(settings);
+}
+
+void DkDeskewBatchPlugin::readSettings(QSettings & settings) const {
+
+	settings.beginGroup("affineTransformPlugin");
+	int interpolation = settings.value("interpolation", mInterpolation).toInt();
+	if (interpolation >= 0 && interpolation < DkImageWarp::interp_end)
+		mInterpolation = interpolation;
+	mCrop = settings.value("cropEnabled", mCrop ? Qt::Checked : Qt::Unchecked).toInt() == Qt::Checked;
+	settings.endGroup();
+}
+
+void DkDeskewBatchPlugin::saveSettings(QSettings & settings) const {
+
+	settings.beginGroup("affineTransformPlugin");
+	settings.setValue("interpolation", mInterpolation);
+	settings.setValue("cropEnabled", mCrop ? Qt::Checked : Qt::Unchecked);
+	settings.endGroup();
+}
+
+};
@@ -27,6 +27,8 @@
 
 #include "DkFakeMiniaturesDialog.h"
 
+#include <QtConcurrentRun>
+
 #define INIT_X 0
 #define INIT_Y 0.7117
 #define INIT_WIDTH 1
@@ -44,6 +46,8 @@ DkFakeMiniaturesDialog::DkFakeMiniaturesDialog(QWidget* parent, Qt::WindowFlags
 
 DkFakeMiniaturesDialog::~DkFakeMiniaturesDialog() {
 
+	cancelRender();
+	renderWatcher.waitForFinished();
 }
 
 /**
@@ -62,6 +66,12 @@ void DkFakeMiniaturesDialog::init() {
 	setWindowTitle(tr("Fake Miniatures"));
 	setFixedSize(dialogWidth, dialogHeight);
 	createLayout();
+
+	progressTimer = new QTimer(this);
+	progressTimer->setInterval(100);
+	connect(progressTimer, SIGNAL(timeout()), this, SLOT(updateRenderProgress()));
+	connect(this, SIGNAL(renderProgress(int)), progressBar, SLOT(setValue(int)));
+	connect(&renderWatcher, SIGNAL(finished()), this, SLOT(renderFinished()));
 }
 
 /**
@@ -93,11 +103,17 @@ void DkFakeMiniaturesDialog::createLayout() {
 	QSpacerItem* spacer = new QSpacerItem(20,280, QSizePolicy::Minimum, QSizePolicy::Minimum);
 	toolsLayout->addItem(spacer);
 
+	// progress of the final rendering
+	progressBar = new QProgressBar(eastWidget);
+	progressBar->setTextVisible(false);
+	progressBar->hide();
+	toolsLayout->addWidget(progressBar);
+
 	// bottom widget - buttons	
 	//QWidget* bottomWidget = new QWidget(eastWidget);
 	QHBoxLayout* bottomWidgetHBoxLayout = new QHBoxLayout();
 
-	QPushButton* buttonOk = new QPushButton(tr("&Ok"));
+	buttonOk = new QPushButton(tr("&Ok"));
 	connect(buttonOk, SIGNAL(clicked()), this, SLOT(okPressed()));
 	QPushButton* buttonCancel = new QPushButton(tr("&Cancel"));
 	connect(buttonCancel, SIGNAL(clicked()), this, SLOT(cancelPressed()));
@@ -159,6 +175,10 @@ void DkFakeMiniaturesDialog::createImgPreview() {
 
 	if(rMin < 1) scaledImg = img->scaled(imgSizeScaled, Qt::KeepAspectRatio, Qt::SmoothTransformation);
 	else scaledImg = *img;
+
+#ifdef WITH_OPENCV
+	previewBlur.setImage(DkFakeMiniaturesDialog::qImage2Mat(scaledImg));
+#endif
 	
 	imgPreview = applyMiniaturesFilter(scaledImg, QRect(INIT_X, INIT_Y*scaledImg.height(), INIT_WIDTH*scaledImg.width(), INIT_HEIGHT*scaledImg.height())); 
 	
@@ -246,167 +266,155 @@ QImage DkFakeMiniaturesDialog::applyMiniaturesFilter(QImage inImg, QRect qRoi) {
 	merge(channelsImg, imgMat);
 	*/
 
+#endif
+
+	// compare the cache keys - operator== would compare all pixels
+	bool isPreview = inImg.cacheKey() == scaledImg.cacheKey();
+
 	int kernelSize = kernelSizeWidget->getToolValue();
-	if (inImg == scaledImg) {
+	if (isPreview) {
 		double diagO = sqrt(img->width()*img->width()+img->height()*img->height());
 		double diagP = sqrt(scaledImg.width()*scaledImg.width()+scaledImg.height()*scaledImg.height());
 		kernelSize = qRound(kernelSize*diagP/diagO);
 	}
 
-	int saturation = saturationWidget->getToolValue();
-	float satFactor = saturation/50.0f + 1; 
-
-	cv::Mat blurImg = DkFakeMiniaturesDialog::qImage2Mat(inImg);
-	cv::Mat distImg(blurImg.size(), CV_8UC1);
-	distImg = 255;
-	cv::Mat roi(distImg, Rect(qRoi.topLeft().x(), qRoi.topLeft().y(), qRoi.width(), qRoi.height()));
-	roi.setTo(0);
-	// blur plane by plane
-	std::vector<cv::Mat> planes;
-	cv::split(blurImg, planes);
-
-	// dist image based on 'some' threshold
-	//cv::Mat distImg;
-	//cv::threshold(planes.at(0), distImg, 40, 255, THRESH_BINARY);
-
-	cv::distanceTransform(distImg, distImg, CV_DIST_C, 3);
-	cv::normalize(distImg, distImg, 1.0f, 0.0f, NORM_MINMAX);
-	
-	for (size_t idx = 0; idx < planes.size(); idx++)
-		planes.at(idx) = blurPanTilt(planes.at(idx), distImg, kernelSize);		// 140 is the maximal blurring kernel size
-		//planes.at(idx) = distImg;
+#ifdef WITH_OPENCV
+	// the preview's integral image is cached, so dragging the ROI only updates the distance map
+	if (isPreview && !previewBlur.isEmpty())
+		return renderMiniature(previewBlur, qRoi, kernelSize, saturationFactor());
+#endif
 
-	cv::merge(planes, blurImg);
-	//return (DkFakeMiniaturesDialog::mat2QImage(blurImg));
+	return renderMiniature(inImg, qRoi, kernelSize, saturationFactor());
+}
 
-	if(satFactor > 1) {
-		Mat imgHsv;
-		cvtColor(blurImg, imgHsv, CV_RGB2HSV);
-		std::vector<Mat> imgHsvCh;
-		split(imgHsv, imgHsvCh);
+/**
+ * renders the fake miniature - this function can be called from worker threads
+ * @param inImg image where the filter is applied
+ * @param qRoi the rectangle that will not be blurred
+ * @param kernelSize maximal blur kernel size
+ * @param satFactor saturation factor (1 keeps the saturation)
+ * @param progress if set, the number of blurred rows is added
+ * @param abort if set, the rendering stops and a null image is returned
+ * @return image with filter applied
+ **/
+QImage DkFakeMiniaturesDialog::renderMiniature(const QImage& inImg, QRect qRoi, int kernelSize, float satFactor, QAtomicInt* progress, const QAtomicInt* abort) {
 
-		for (int row = 0; row < imgHsv.rows; row++)
-		{
-			unsigned char *ptr = imgHsvCh[1].ptr<unsigned char>(row);
-	 	
-			for (int col = 0; col < imgHsv.cols; col++) {
-				float tmp = (float)ptr[col] * satFactor;
-				if (tmp > 255.0f) tmp = 255.0f;
-				if (tmp < 0) tmp = 0.0f;
-				ptr[col] = (unsigned char)qRound(tmp);
-			}
-		}
-	
-		merge(imgHsvCh, imgHsv);
-		Mat tempImg(blurImg);
-		cvtColor(imgHsv, blurImg, CV_HSV2RGB);
-	
-		if(tempImg.type() == CV_8UC4) {	// the retImg is always CV_8UC3, so for pics in CV_8UC4 we need to add one channel
-			std::vector<Mat> inImgCh;
-			split(tempImg, inImgCh);
-			std::vector<Mat> retImgCh;
-			split(blurImg, retImgCh);
-			retImgCh.push_back(inImgCh[3]);
-			merge(retImgCh, blurImg);
-		}
-	}
-	
-	return (DkFakeMiniaturesDialog::mat2QImage(blurImg));
+#ifdef WITH_OPENCV
+	DkMiniatureBlur blurEngine(DkFakeMiniaturesDialog::qImage2Mat(inImg));
+	return renderMiniature(blurEngine, qRoi, kernelSize, satFactor, progress, abort);
 #else
 	return inImg;
 #endif
 }
 
 #ifdef WITH_OPENCV
+QImage DkFakeMiniaturesDialog::renderMiniature(const DkMiniatureBlur& blurEngine, QRect qRoi, int kernelSize, float satFactor, QAtomicInt* progress, const QAtomicInt* abort) {
+
+	cv::Mat distImg = DkMiniatureBlur::distanceMap(blurEngine.image().size(), Rect(qRoi.topLeft().x(), qRoi.topLeft().y(), qRoi.width(), qRoi.height()));
+
+	// blur all channels at once and increase the saturation in the same pass
+	cv::Mat blurImg = blurEngine.blur(distImg, kernelSize, satFactor, progress, abort);		// 140 is the maximal blurring kernel size
+
+	if (blurImg.empty())
+		return QImage();
+
+	return (DkFakeMiniaturesDialog::mat2QImage(blurImg));
+}
+#endif
+
 /**
- * blur filter
- * @param src input Mat
- * @param depthImg distance transform based on a roi
- * @param maxKernel maximum blur kernel size 
- * @return Mat blurres mat
+ * on button ok pressed event
  **/
-Mat DkFakeMiniaturesDialog::blurPanTilt(Mat src, Mat depthImg, int maxKernel) {
-
-	cv::Mat integralImg;
+void DkFakeMiniaturesDialog::okPressed() {
 
-	cv::Mat blurImg(src.size(), src.depth());
+	startRender();
+}
 
-	// a template function would have more 'style' here
-	const double* itgrl64Ptr = 0;
+/**
+ * on button cancel pressed event
+ **/
+void DkFakeMiniaturesDialog::cancelPressed() {
 
-	// images with an area below 4000*4000 can be compuated using 32 bit 
-	cv::integral(src, integralImg, CV_32S);
-	const unsigned int* itgrl32Ptr = integralImg.ptr<unsigned int>();
+	// stop the final rendering but keep the dialog open
+	if (renderWatcher.isRunning()) {
+		cancelRender();
+		return;
+	}
 
-	for (int rIdx = 0; rIdx < src.rows; rIdx++) {
+	this->close();
+}
 
-		unsigned char* blurPtr = blurImg.ptr<unsigned char>(rIdx);	// assuming unsigned char
-		const float* depthPtr = depthImg.ptr<float>(rIdx);
-		const unsigned char* srcPtr = src.ptr<unsigned char>(rIdx);
+/**
+ * renders the full resolution image in the background
+ * the preview keeps showing the coarse result until it is finished
+ **/
+void DkFakeMiniaturesDialog::startRender() {
 
-		for (int cIdx = 0; cIdx < src.cols; cIdx++) {
+	if (!img || renderWatcher.isRunning())
+		return;
 
-			// kernel size depends on the distance transform, the user selected
-			float dpv = depthPtr[cIdx];
-			float ksf = depthPtr[cIdx]*maxKernel*0.5f;
+	QImage inImg = *img;
+	QRect roi = imageRoi();
+	int kernelSize = kernelSizeWidget->getToolValue();
+	float satFactor = saturationFactor();
 
-			//if (!ks) {
-			//	blurPtr[cIdx] = srcPtr[cIdx];
-			//	continue;
-			//}
-			
-			int ks = qRound(ksf);
-			if (ksf > 0 && ksf < 2) ks = 2;
-			else if (ks == 0) { // early skip
-				blurPtr[cIdx] = srcPtr[cIdx];
-				continue;
-			}
+	renderAbort = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+	renderRows = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+	QSharedPointer<QAtomicInt> abort = renderAbort;
+	QSharedPointer<QAtomicInt> rows = renderRows;
 
-			// clip all coordinates
-			int left	= qMax(cIdx-ks, 0);
-			int right	= qMin(cIdx+ks+1, src.cols);	// note not cols-1 since integral img is src.cols+1
-			int bottom	= qMax(rIdx-ks, 0);				// note top bottom is flipped since -y coords
-			int top		= qMin(rIdx+ks+1, src.rows);
-			int area	= (right-left)*(top-bottom);
+	progressBar->setRange(0, inImg.height());
+	setRendering(true);
 
-			top *= integralImg.cols;
-			bottom *= integralImg.cols;
+	renderWatcher.setFuture(QtConcurrent::run([inImg, roi, kernelSize, satFactor, rows, abort]() {
+		return DkFakeMiniaturesDialog::renderMiniature(inImg, roi, kernelSize, satFactor, rows.data(), abort.data());
+	}));
+}
 
-			float tmp = 0.0f;
+void DkFakeMiniaturesDialog::cancelRender() {
 
-			// compute mean kernel
-			if (area && itgrl32Ptr && ks > 1)
-				tmp = (*(itgrl32Ptr + top+right) + *(itgrl32Ptr + bottom+left) - *(itgrl32Ptr + top+left) - *(itgrl32Ptr + bottom+right))/area;
-			else
-				tmp = srcPtr[cIdx];
+	if (renderAbort)
+		renderAbort->store(1);
+}
 
-			if (tmp < 0)
-				tmp = 0.0f;
-			if (tmp > 255)
-				tmp = 255.0f;
+void DkFakeMiniaturesDialog::setRendering(bool rendering) {
 
-			blurPtr[cIdx] = qRound(tmp);
-		}
-	}
+	progressBar->setValue(0);
+	progressBar->setVisible(rendering);
+	buttonOk->setEnabled(!rendering);
+	kernelSizeWidget->setEnabled(!rendering);
+	saturationWidget->setEnabled(!rendering);
+	previewLabel->setEnabled(!rendering);
 
-	return blurImg;
+	if (rendering)
+		progressTimer->start();
+	else
+		progressTimer->stop();
 }
-#endif
 
-/**
- * on button ok pressed event
- **/
-void DkFakeMiniaturesDialog::okPressed() {
+void DkFakeMiniaturesDialog::updateRenderProgress() {
 
-	isOk = true;
-	this->close();
+	if (renderRows)
+		emit renderProgress(renderRows->load());
 }
 
-/**
- * on button cancel pressed event
- **/
-void DkFakeMiniaturesDialog::cancelPressed() {
+void DkFakeMiniaturesDialog::renderFinished() {
+
+	setRendering(false);
+
+	QImage result = renderWatcher.result();
+
+	// canceled - or the dialog was closed before the result arrived
+	if (result.isNull() || renderAbort->load() || !isVisible())
+		return;
+
+	miniature = result;
+
+	// replace the coarse preview with the final result
+	imgPreview = miniature.scaled(previewImgRect.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	drawImgPreview();
 
+	isOk = true;
 	this->close();
 }
 
@@ -416,11 +424,27 @@ void DkFakeMiniaturesDialog::cancelPressed() {
 void DkFakeMiniaturesDialog::showEvent(QShowEvent *event) {
 
 	isOk = false;	
+	miniature = QImage();
 	double diag = sqrt(img->width()*img->width()+img->height()*img->height());
 	kernelSizeWidget->setToolValue(qMin(qMax(int(diag * 0.02), 5), 140));
 	saturationWidget->setToolValue(2);
 }
 
+/**
+ * Esc (and closing the window) must not leave the final rendering running
+ **/
+void DkFakeMiniaturesDialog::reject() {
+
+	cancelRender();
+	QDialog::reject();
+}
+
+void DkFakeMiniaturesDialog::closeEvent(QCloseEvent *event) {
+
+	cancelRender();
+	QDialog::closeEvent(event);
+}
+
 void DkFakeMiniaturesDialog::setImage(const QImage *img) {
 
 	this->img = img;
@@ -433,6 +457,18 @@ void DkFakeMiniaturesDialog::setImage(const QImage *img) {
  **/
 QImage DkFakeMiniaturesDialog::getImage() {
 
+	// rendered in the background
+	if (!miniature.isNull())
+		return miniature;
+
+	return renderMiniature(*(this->img), imageRoi(), kernelSizeWidget->getToolValue(), saturationFactor());
+};
+
+/**
+ * maps the preview ROI to the full resolution image
+ **/
+QRect DkFakeMiniaturesDialog::imageRoi() const {
+
 	QRect rescaledRect = previewLabel->getROI();
 	rescaledRect.moveTo(rescaledRect.topLeft().x()-previewImgRect.topLeft().x(), rescaledRect.topLeft().y()-previewImgRect.topLeft().y());
 	if(rMin < 1) {
@@ -446,16 +482,21 @@ QImage DkFakeMiniaturesDialog::getImage() {
 	if(rescaledRect.bottomRight().x() > imgRect.bottomRight().x()) rescaledRect.bottomRight().setX(imgRect.bottomRight().x());
 	if(rescaledRect.bottomRight().y() > imgRect.bottomRight().y()) rescaledRect.bottomRight().setY(imgRect.bottomRight().y());
 
-	QImage miniature = applyMiniaturesFilter(*(this->img), rescaledRect);
-	return miniature;
-};
+	return rescaledRect;
+}
+
+float DkFakeMiniaturesDialog::saturationFactor() const {
+
+	int saturation = saturationWidget->getToolValue();
+	return saturation/50.0f + 1;
+}
 
 /**
  * slot that redraws preview after slider change
  **/
 void DkFakeMiniaturesDialog::redrawImgPreview() {
 	
-	QRect rescaledRect = previewLabel->getROI();
+	QRect rescaledRect = previewLabel->getROI().normalized();
 	rescaledRect.moveTo(rescaledRect.topLeft().x()-previewImgRect.topLeft().x(), rescaledRect.topLeft().y()-previewImgRect.topLeft().y());
 	setImagePreview(applyMiniaturesFilter(getScaledImg(), rescaledRect));
 	drawImgPreview();
@@ -492,6 +533,9 @@ void DkPreviewLabel::mouseMoveEvent(QMouseEvent *e) {
 		QPoint pos = e->pos();
 		if(pos.x() > previewImgRect.topLeft().x() && pos.x() < previewImgRect.bottomRight().x() && pos.y() > previewImgRect.topLeft().y() && pos.y() < previewImgRect.bottomRight().y()) {
 			selectionRect.setBottomRight(pos);
+
+			// live preview - only the distance map and the blur are recomputed
+			fmDialog->redrawImgPreview();
 		}
 		repaint();
     }
@@ -36,6 +36,11 @@
 #include <QDialog>
 #include <QPainter>
 #include <QMouseEvent>
+#include <QProgressBar>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QTimer>
 
 // OpenCV
 #ifdef WITH_OPENCV
@@ -50,6 +55,8 @@
 using namespace cv;
 #endif
 
+#include "DkMiniatureBlur.h"
+
 namespace nmp {
 
 class DkPreviewLabel;
@@ -74,12 +81,20 @@ class DkFakeMiniaturesDialog : public QDialog {
 		QImage getScaledImg() {return scaledImg;};
 		void drawImgPreview();	
 
+		static QImage renderMiniature(const QImage& inImg, QRect qRoi, int kernelSize, float satFactor, QAtomicInt* progress = 0, const QAtomicInt* abort = 0);
+
 	public slots:
 		void redrawImgPreview();
+		void reject();
+
+	signals:
+		void renderProgress(int rows);
 
 	protected slots:
 		void okPressed();
 		void cancelPressed();
+		void renderFinished();
+		void updateRenderProgress();
 
 	protected:
 		bool isOk;
@@ -93,6 +108,19 @@ class DkFakeMiniaturesDialog : public QDialog {
 		float rMin;
 		DkKernelSize *kernelSizeWidget;
 		DkSaturation *saturationWidget;
+		QPushButton* buttonOk;
+		QProgressBar* progressBar;
+
+		// final rendering
+		QFutureWatcher<QImage> renderWatcher;
+		QSharedPointer<QAtomicInt> renderAbort;
+		QSharedPointer<QAtomicInt> renderRows;
+		QTimer* progressTimer;
+		QImage miniature;
+
+#ifdef WITH_OPENCV
+		DkMiniatureBlur previewBlur;	// integral image of scaledImg - reused while the ROI changes
+#endif
 
 		int previewWidth;
 		int previewHeight;
@@ -102,10 +130,16 @@ class DkFakeMiniaturesDialog : public QDialog {
 		void init();
 		void createLayout();
 		void showEvent(QShowEvent *event);
+		void closeEvent(QCloseEvent *event);
 		void createImgPreview();		
+		QRect imageRoi() const;
+		float saturationFactor() const;
+		void startRender();
+		void setRendering(bool rendering);
+		void cancelRender();
 
 #ifdef WITH_OPENCV
-		Mat blurPanTilt(Mat src, Mat depthImg, int maxKernel);
+		static QImage renderMiniature(const DkMiniatureBlur& blurEngine, QRect qRoi, int kernelSize, float satFactor, QAtomicInt* progress = 0, const QAtomicInt* abort = 0);
 
 	/**
 	 * Converts a QImage to a Mat
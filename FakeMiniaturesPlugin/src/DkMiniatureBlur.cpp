@@ -0,0 +1,415 @@
+/*******************************************************************************************************
+ DkMiniatureBlur.cpp
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkMiniatureBlur.h"
+#include "DkMiniatureUtils.h"
+
+#ifdef WITH_OPENCV
+
+#include <string.h>
+
+namespace nmp {
+
+namespace {
+
+/**
+ * Kernel radius for a depth value in [0 1].
+ * Blurred pixels use at least a radius of 2, 0 keeps the pixel.
+ **/
+inline int kernelRadius(float depth, int maxKernel) {
+
+	float ksf = depth * maxKernel * 0.5f;
+
+	if (ksf > 0 && ksf < 2)
+		return 2;
+
+	return cvRound(ksf);
+}
+
+template <typename T>
+void integralRows(const cv::Mat& src, T* integral, int rowStart, int rowEnd) {
+
+	const int cn = src.channels();
+	const size_t stride = (size_t)(src.cols + 1) * cn;
+
+	for (int rIdx = rowStart; rIdx < rowEnd; rIdx++) {
+
+		const unsigned char* srcPtr = src.ptr<unsigned char>(rIdx);
+		T* iPtr = integral + (rIdx + 1) * stride + cn;
+		T sum[4] = {0, 0, 0, 0};
+
+		for (int cIdx = 0; cIdx < src.cols * cn; cIdx += cn) {
+			for (int c = 0; c < cn; c++) {
+				sum[c] += srcPtr[cIdx + c];
+				iPtr[cIdx + c] = sum[c];
+			}
+		}
+	}
+}
+
+/**
+ * Computes the integral image of all channels.
+ * The rows are summed up in bands, then the columns are accumulated in stripes.
+ **/
+template <typename T>
+void integralImage(const cv::Mat& src, std::vector<T>& integral) {
+
+	const int cn = src.channels();
+	const size_t stride = (size_t)(src.cols + 1) * cn;
+
+	// padded by one pixel, so that 3 channel images can be read with 4 lanes
+	integral.assign((src.rows + 1) * stride + 4, 0);
+	T* iPtr = &integral[0];
+
+	int nb = numBands(src.rows);
+	cv::parallel_for_(cv::Range(0, nb), [&](const cv::Range& r) {
+
+		for (int bIdx = r.start; bIdx < r.end; bIdx++)
+			integralRows(src, iPtr, (int)((int64)src.rows * bIdx / nb), (int)((int64)src.rows * (bIdx + 1) / nb));
+	});
+
+	int ns = numBands((int)stride);
+	cv::parallel_for_(cv::Range(0, ns), [&](const cv::Range& r) {
+
+		size_t xStart = stride * r.start / ns;
+		size_t xEnd = stride * r.end / ns;
+
+		for (int rIdx = 2; rIdx <= src.rows; rIdx++) {
+
+			T* row = iPtr + rIdx * stride;
+			const T* prev = row - stride;
+
+			for (size_t x = xStart; x < xEnd; x++)
+				row[x] += prev[x];
+		}
+	});
+}
+
+#ifdef DK_BLUR_SSE2
+// sum of the box for 4 lanes (the 4th lane is ignored for 3 channel images)
+inline __m128i boxSum4(const uint32_t* tl, const uint32_t* tr, const uint32_t* bl, const uint32_t* br) {
+
+	// unsigned wrap around cancels out
+	__m128i s = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)br), _mm_loadu_si128((const __m128i*)bl));
+	s = _mm_sub_epi32(s, _mm_loadu_si128((const __m128i*)tr));
+	return _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)tl));
+}
+
+inline __m128i boxSum4(const uint64_t* tl, const uint64_t* tr, const uint64_t* bl, const uint64_t* br) {
+
+	__m128i lo = _mm_sub_epi64(_mm_loadu_si128((const __m128i*)br), _mm_loadu_si128((const __m128i*)bl));
+	lo = _mm_sub_epi64(lo, _mm_loadu_si128((const __m128i*)tr));
+	lo = _mm_add_epi64(lo, _mm_loadu_si128((const __m128i*)tl));
+
+	__m128i hi = _mm_sub_epi64(_mm_loadu_si128((const __m128i*)(br + 2)), _mm_loadu_si128((const __m128i*)(bl + 2)));
+	hi = _mm_sub_epi64(hi, _mm_loadu_si128((const __m128i*)(tr + 2)));
+	hi = _mm_add_epi64(hi, _mm_loadu_si128((const __m128i*)(tl + 2)));
+
+	// box sums fit into 32 bit - keep the lower halves
+	return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+#endif
+
+/**
+ * Scales the saturation of a color (the first three channels) while keeping hue and value.
+ * This equals scaling S in HSV space and clipping it to 1, but it needs no conversion.
+ * Further channels (alpha) are not changed.
+ **/
+inline void saturate(float* px, float satFactor) {
+
+	float maxV = cv::max(px[0], cv::max(px[1], px[2]));
+	float minV = cv::min(px[0], cv::min(px[1], px[2]));
+
+	if (maxV == minV)
+		return;
+
+	float g = cv::min(satFactor, maxV / (maxV - minV));
+
+	for (int c = 0; c < 3; c++)
+		px[c] = maxV - g * (maxV - px[c]);
+}
+
+#ifdef DK_BLUR_SSE2
+inline __m128 saturate(__m128 px, __m128 satFactor) {
+
+	// compare all color channels - the 4th lane only compares to itself
+	__m128 s1 = _mm_shuffle_ps(px, px, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 s2 = _mm_shuffle_ps(px, px, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 maxV = _mm_max_ps(px, _mm_max_ps(s1, s2));
+	__m128 minV = _mm_min_ps(px, _mm_min_ps(s1, s2));
+
+	// gray values divide by 0 - min_ps returns the 2nd operand for NaN, so g = satFactor and px is unchanged
+	__m128 g = _mm_min_ps(_mm_div_ps(maxV, _mm_sub_ps(maxV, minV)), satFactor);
+
+	return _mm_sub_ps(maxV, _mm_mul_ps(g, _mm_sub_ps(maxV, px)));
+}
+
+inline __m128 loadPixel(const unsigned char* px, int cn) {
+
+	int val = 0;
+	memcpy(&val, px, cn);
+
+	__m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(val), _mm_setzero_si128());
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+}
+
+inline void storePixel(__m128 px, unsigned char* dst, int cn) {
+
+	__m128i v = _mm_cvtps_epi32(px);
+	v = _mm_packs_epi32(v, v);
+	v = _mm_packus_epi16(v, v);
+
+	int val = _mm_cvtsi128_si32(v);
+	memcpy(dst, &val, cn);
+}
+#endif
+
+/**
+ * Blurs the rows [rowStart rowEnd).
+ * If satFactor > 1, the saturation of color images is increased in the same pass.
+ **/
+template <typename T>
+void blurRows(const cv::Mat& src, const T* integral, const cv::Mat& depthImg, int maxKernel, float satFactor, cv::Mat& dst, int rowStart, int rowEnd) {
+
+	const int cn = src.channels();
+	const int stride = (src.cols + 1) * cn;
+	const bool sat = satFactor > 1.0f && cn >= 3;
+
+#ifdef DK_BLUR_SSE2
+	const __m128 satV = _mm_set1_ps(satFactor);
+#endif
+
+	for (int rIdx = rowStart; rIdx < rowEnd; rIdx++) {
+
+		const unsigned char* srcPtr = src.ptr<unsigned char>(rIdx);
+		const float* depthPtr = depthImg.ptr<float>(rIdx);
+		unsigned char* dstPtr = dst.ptr<unsigned char>(rIdx);
+
+		for (int cIdx = 0; cIdx < src.cols; cIdx++) {
+
+			int ks = kernelRadius(depthPtr[cIdx], maxKernel);
+			int px = cIdx * cn;
+
+			if (!ks && !sat) {
+				memcpy(dstPtr + px, srcPtr + px, cn);
+				continue;
+			}
+
+			// clip all coordinates
+			int left	= cv::max(cIdx - ks, 0) * cn;
+			int right	= cv::min(cIdx + ks + 1, src.cols) * cn;
+			int top		= cv::max(rIdx - ks, 0);
+			int bottom	= cv::min(rIdx + ks + 1, src.rows);
+			float invArea = 1.0f / ((right - left) / cn * (bottom - top));
+
+			const T* tPtr = integral + (size_t)top * stride;
+			const T* bPtr = integral + (size_t)bottom * stride;
+
+#ifdef DK_BLUR_SSE2
+			if (cn >= 3) {
+
+				__m128 v;
+				
+				if (ks)
+					v = _mm_mul_ps(_mm_cvtepi32_ps(boxSum4(tPtr + left, tPtr + right, bPtr + left, bPtr + right)), _mm_set1_ps(invArea));
+				else
+					v = loadPixel(srcPtr + px, cn);
+
+				if (sat)
+					v = saturate(v, satV);
+
+				storePixel(v, dstPtr + px, cn);
+				continue;
+			}
+#endif
+			float vals[4];
+
+			for (int c = 0; c < cn; c++) {
+
+				if (ks) {
+					T sum = bPtr[right + c] - bPtr[left + c] - tPtr[right + c] + tPtr[left + c];
+					vals[c] = (float)sum * invArea;
+				}
+				else
+					vals[c] = srcPtr[px + c];
+			}
+
+			if (sat)
+				saturate(vals, satFactor);
+
+			for (int c = 0; c < cn; c++)
+				dstPtr[px + c] = cv::saturate_cast<unsigned char>(cvRound(vals[c]));
+		}
+	}
+}
+
+template <typename T>
+cv::Mat blurImage(const cv::Mat& src, const std::vector<T>& integral, const cv::Mat& depthImg, int maxKernel, float satFactor, QAtomicInt* progress, const QAtomicInt* abort) {
+
+	cv::Mat dst(src.size(), src.type());
+	const T* iPtr = &integral[0];
+
+	int nb = numBands(src.rows);
+	cv::parallel_for_(cv::Range(0, nb), [&](const cv::Range& r) {
+
+		for (int bIdx = r.start; bIdx < r.end; bIdx++) {
+
+			// bands that did not start yet are skipped
+			if (abort && abort->load())
+				return;
+
+			int rowStart = (int)((int64)src.rows * bIdx / nb);
+			int rowEnd = (int)((int64)src.rows * (bIdx + 1) / nb);
+			blurRows(src, iPtr, depthImg, maxKernel, satFactor, dst, rowStart, rowEnd);
+
+			if (progress)
+				progress->fetchAndAddRelaxed(rowEnd - rowStart);
+		}
+	});
+
+	if (abort && abort->load())
+		return cv::Mat();
+
+	return dst;
+}
+
+}
+
+DkMiniatureBlur::DkMiniatureBlur(const cv::Mat& img) {
+
+	setImage(img);
+}
+
+/**
+ * Sets the image and computes its integral image.
+ * @param img 8 bit image with 1 to 4 channels
+ **/
+void DkMiniatureBlur::setImage(const cv::Mat& img) {
+
+	src = img;
+	integral32.clear();
+	integral64.clear();
+
+	if (src.empty() || src.depth() != CV_8U || src.channels() > 4) {
+		src = cv::Mat();
+		return;
+	}
+
+	computeIntegral();
+}
+
+cv::Mat DkMiniatureBlur::image() const {
+	return src;
+}
+
+bool DkMiniatureBlur::isEmpty() const {
+	return src.empty();
+}
+
+bool DkMiniatureBlur::is64Bit() const {
+	return !integral64.empty();
+}
+
+void DkMiniatureBlur::computeIntegral() {
+
+	// 32 bit are enough as long as the sum of the whole image cannot overflow
+	if ((double)src.rows * src.cols * 255.0 < 4294967296.0)
+		integralImage(src, integral32);
+	else
+		integralImage(src, integral64);
+}
+
+/**
+ * Blurs the image.
+ * @param depthImg CV_32F map in [0 1] with the image's size - 0 keeps the pixel
+ * @param maxKernel maximum blur kernel size
+ * @param satFactor saturation factor for 3 and 4 channel images (1 keeps the saturation, alpha is not changed)
+ * @param progress if set, the number of finished rows is added
+ * @param abort if set, the remaining rows are skipped
+ * @return the blurred image (with the image's type) or an empty Mat if aborted
+ **/
+cv::Mat DkMiniatureBlur::blur(const cv::Mat& depthImg, int maxKernel, float satFactor, QAtomicInt* progress, const QAtomicInt* abort) const {
+
+	if (src.empty() || depthImg.size() != src.size() || depthImg.type() != CV_32FC1)
+		return src.clone();
+
+	if (is64Bit())
+		return blurImage(src, integral64, depthImg, maxKernel, satFactor, progress, abort);
+	else
+		return blurImage(src, integral32, depthImg, maxKernel, satFactor, progress, abort);
+}
+
+/**
+ * Computes the normalized chessboard distance to a rectangle.
+ * This equals cv::distanceTransform(CV_DIST_C) followed by a min max
+ * normalization, but it is computed directly from the rectangle.
+ * @param size the image size
+ * @param roi the rectangle that will not be blurred
+ * @return CV_32F map in [0 1]
+ **/
+cv::Mat DkMiniatureBlur::distanceMap(const cv::Size& size, const cv::Rect& roi) {
+
+	cv::Mat distImg(size, CV_32FC1);
+	cv::Rect r = roi & cv::Rect(0, 0, size.width, size.height);
+
+	int left	= r.x;
+	int right	= r.x + r.width - 1;
+	int top		= r.y;
+	int bottom	= r.y + r.height - 1;
+	int maxDist = cv::max(cv::max(left, size.width - 1 - right), cv::max(top, size.height - 1 - bottom));
+
+	if (r.width <= 0 || r.height <= 0 || maxDist <= 0) {
+		distImg.setTo(0);
+		return distImg;
+	}
+
+	float invMax = 1.0f / maxDist;
+
+	int nb = numBands(size.height);
+	cv::parallel_for_(cv::Range(0, nb), [&](const cv::Range& range) {
+
+		int rowStart = (int)((int64)size.height * range.start / nb);
+		int rowEnd = (int)((int64)size.height * range.end / nb);
+
+		for (int rIdx = rowStart; rIdx < rowEnd; rIdx++) {
+
+			float* distPtr = distImg.ptr<float>(rIdx);
+			int dy = cv::max(cv::max(top - rIdx, rIdx - bottom), 0);
+
+			for (int cIdx = 0; cIdx < size.width; cIdx++) {
+				int dx = cv::max(cv::max(left - cIdx, cIdx - right), 0);
+				distPtr[cIdx] = cv::max(dx, dy) * invMax;
+			}
+		}
+	});
+
+	return distImg;
+}
+
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*******************************************************************************************************
+ DkMiniatureBlur.h
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#ifdef WITH_OPENCV
+
+#include "opencv2/core/core.hpp"
+
+#include <QAtomicInt>
+
+#include <vector>
+#include <stdint.h>
+
+namespace nmp {
+
+/**
+ * Variable radius box blur for 8 bit images with 1 to 4 interleaved channels.
+ * The integral image of all channels is computed once - with 32 bit values
+ * if the sum of the whole image fits, with 64 bit values otherwise.
+ * Each pixel is then averaged over a box whose radius is given by a depth
+ * map (0 keeps the pixel, 1 uses the maximal kernel). The saturation can
+ * be increased in the same pass.
+ **/
+class DkMiniatureBlur {
+
+public:
+	DkMiniatureBlur(const cv::Mat& img = cv::Mat());
+
+	void setImage(const cv::Mat& img);
+	cv::Mat image() const;
+	bool isEmpty() const;
+	bool is64Bit() const;
+
+	cv::Mat blur(const cv::Mat& depthImg, int maxKernel, float satFactor = 1.0f, QAtomicInt* progress = 0, const QAtomicInt* abort = 0) const;
+
+	static cv::Mat distanceMap(const cv::Size& size, const cv::Rect& roi);
+
+protected:
+	void computeIntegral();
+
+	cv::Mat src;
+	std::vector<uint32_t> integral32;	// (rows+1) x (cols+1) x channels
+	std::vector<uint64_t> integral64;	// used instead if 32 bit might overflow
+};
+
+};
+
+#endif
@@ -0,0 +1,52 @@
+/*******************************************************************************************************
+ DkMiniatureUtils.h
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#ifdef WITH_OPENCV
+
+#include "opencv2/core/core.hpp"
+
+// the blur passes have SSE2 paths (always available on x64)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DK_BLUR_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace nmp {
+
+/**
+ * Returns the number of row bands - about four per thread.
+ **/
+inline int numBands(int rows) {
+
+	return cv::max(cv::min(cv::getNumThreads() * 4, rows), 1);
+}
+
+};
+
+#endif
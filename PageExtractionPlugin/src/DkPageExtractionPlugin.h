@@ -81,7 +81,7 @@ protected:
 	QStringList mMenuStatusTips;
 	QString mResultPath;
 
-	MethodIndex mMethod = m_thresholds;
+	MethodIndex mMethod = m_bhaskar;
 
 	QPolygonF readGT(const QString& imgPath) const;
 	double jaccardIndex(const QSize& imgSize, const QPolygonF& gt, const QPolygonF& computed) const;
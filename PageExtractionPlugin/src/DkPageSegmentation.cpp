@@ -98,117 +98,42 @@ void DkPageSegmentation::compute() {
 
 cv::Mat DkPageSegmentation::findRectangles(const cv::Mat& img, std::vector<DkPolyRect>& rects) const {
 	
-	cv::Mat tImg, gray;
-
+	cv::Mat tImg;
 
 	if (scale != 1.0f)
 		cv::resize(img, tImg, cv::Size(), scale, scale, CV_INTER_AREA);	// inter nn -> assuming resize to be 1/(2^n)
 	else
 		tImg = img;
 
-	std::vector<std::vector<cv::Point> > contours;
-
-	cv::Mat gray0(tImg.size(), CV_8UC1);
-	cv::Mat lImg(tImg.size(), CV_8UC1);
-
-	// find squares in every color plane of the image
-	for( int c = 0; c < 3; c++ ) {
-
-		int ch[] = {c, 0};
-		mixChannels(&tImg, 1, &gray0, 1, ch, 1);
-		cv::normalize(gray0, gray0, 255, 0, cv::NORM_MINMAX);
-
-		if (c == 0)	// back-up the luminance channel - we use it as precomputed image for the circle detection
-			lImg = gray0.clone();
-
-		int nT = numThresh;//(c == 0) ? numThresh*2 : numThresh;	// more luminance thresholds
-
-							// try several threshold levels
-		for( int l = 0; l < nT; l++ ) {
+	// normalize every color plane of the image
+	std::vector<cv::Mat> planes;
+	cv::split(tImg, planes);
+	planes.resize(3);
 
-			// hack: use Canny instead of zero threshold level.
-			// Canny helps to catch squares with gradient shading
-			if( l == 0 ) {
+	for (int c = 0; c < 3; c++) {
 
-				Canny(gray0, gray, thresh, thresh*3, 5);
-				// dilate canny output to remove potential
-				// holes between edge segments
-				dilate(gray, gray, cv::Mat(), cv::Point(-1,-1));
-
-				//DkIP::imwrite("edgeImg.png", gray);
-			}
-			else {
-				gray = gray0 >= (l+1)*255/numThresh;
-			}
-
-			// find contours and store them all as a list
-			findContours(gray, contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
+		if (planes[c].empty())	// gray value images
+			planes[c] = planes[0];
+		else
+			cv::normalize(planes[c], planes[c], 255, 0, cv::NORM_MINMAX);
+	}
 
-			if (looseDetection) {
-				std::vector<std::vector<cv::Point> > hull;
-				for (int i = 0; i < (int)contours.size(); i++) { 
+	// back-up the luminance channel - we use it as precomputed image for the circle detection
+	cv::Mat lImg = planes[0].clone();
 
-					double cArea = contourArea(cv::Mat(contours[i]));
+	// every (plane, threshold level) pair is searched independently
+	int nT = numThresh;
+	std::vector<std::vector<DkPolyRect> > levelRects(3*nT);
 
-					if (fabs(cArea) > minArea*scale*scale && (!maxArea || fabs(cArea) < maxArea*(scale*scale))) {
-						std::vector<cv::Point> cHull;
-						cv::convexHull(cv::Mat(contours[i]), cHull, false);
-						hull.push_back(cHull);
-					}
-				}
+	cv::parallel_for_(cv::Range(0, (int)levelRects.size()), [&](const cv::Range& r) {
 
-				contours = hull;
-			}
+		for (int idx = r.start; idx < r.end; idx++)
+			findLevelRectangles(planes[idx / nT], idx % nT, levelRects[idx]);
+	});
 
-			std::vector<cv::Point> approx;
-
-			// DEBUG ------------------------
-			//cv::Mat pImg = image.clone();
-			//cv::cvtColor(pImg, pImg, CV_Lab2RGB);
-			// DEBUG ------------------------
-
-			// test each contour
-			for( size_t i = 0; i < contours.size(); i++ ) {
-				// approxicv::Mate contour with accuracy proportional
-				// to the contour perimeter
-				approxPolyDP(cv::Mat(contours[i]), approx, arcLength(cv::Mat(contours[i]), true)*0.02, true);
-
-				double cArea = contourArea(cv::Mat(approx));
-
-				// DEBUG ------------------------
-				//if (fabs(cArea) < maxArea)
-				//	fillConvexPoly(pImg, &approx[0], (int)approx.size(), DkUtils::blue);
-				// DEBUG ------------------------
-
-				// square contours should have 4 vertices after approxicv::Mation
-				// relatively large area (to filter out noisy contours)
-				// and be convex.
-				// Note: absolute value of an area is used because
-				// area may be positive or negative - in accordance with the
-				// contour orientation
-				if( approx.size() == 4 &&
-					fabs(cArea) > minArea*scale*scale &&
-					(!maxArea || fabs(cArea) < maxArea*scale*scale) && 
-					isContourConvex(cv::Mat(approx)) ) {
-
-					DkPolyRect cr(approx);
-					//moutc << minArea*scale*scale << " < " << fabs(cArea) << " < " << maxArea*scale*scale << dkendl;
-
-					// if cosines of all angles are small
-					// (all angles are ~90 degree)
-					if(/*cr.maxSide() < std::max(tImg.rows, tImg.cols)*maxSideFactor && */
-						(!maxSide || cr.maxSide() < maxSide*scale) && 
-						cr.getMaxCosine() < 0.3 ) {
-						rects.push_back(cr);
-					}
-				}
-			}
-			// DEBUG ------------------------
-			//cv::cvtColor(pImg, pImg, CV_RGB2BGR);
-			//DkIP::imwrite("polyImg" + DkUtils::stringify(c) + "-" + DkUtils::stringify(l) + ".png", pImg);
-			// DEBUG ------------------------
-		}
-	}
+	// merge in plane/level order so that the results do not depend on the scheduling
+	for (const std::vector<DkPolyRect>& lr : levelRects)
+		rects.insert(rects.end(), lr.begin(), lr.end());
 
 	for (size_t idx = 0; idx < rects.size(); idx++)
 		rects[idx].scale(1.0f/scale);
@@ -231,6 +156,94 @@ cv::Mat DkPageSegmentation::findRectangles(const cv::Mat& img, std::vector<DkPol
 	return lImg;
 }
 
+/**
+* Finds rectangles in one threshold level of a normalized color plane.
+* Level 0 uses Canny edges, all other levels binarize the plane.
+**/
+void DkPageSegmentation::findLevelRectangles(const cv::Mat& gray0, int level, std::vector<DkPolyRect>& rects) const {
+
+	cv::Mat gray;
+	std::vector<std::vector<cv::Point> > contours;
+
+	// hack: use Canny instead of zero threshold level.
+	// Canny helps to catch squares with gradient shading
+	if (level == 0) {
+
+		Canny(gray0, gray, thresh, thresh*3, 5);
+		// dilate canny output to remove potential
+		// holes between edge segments
+		dilate(gray, gray, cv::Mat(), cv::Point(-1,-1));
+
+		//DkIP::imwrite("edgeImg.png", gray);
+	}
+	else {
+		gray = gray0 >= (level+1)*255/numThresh;
+	}
+
+	// find contours and store them all as a list
+	findContours(gray, contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
+
+	if (looseDetection) {
+		std::vector<std::vector<cv::Point> > hull;
+		for (int i = 0; i < (int)contours.size(); i++) { 
+
+			double cArea = contourArea(cv::Mat(contours[i]));
+
+			if (fabs(cArea) > minArea*scale*scale && (!maxArea || fabs(cArea) < maxArea*(scale*scale))) {
+				std::vector<cv::Point> cHull;
+				cv::convexHull(cv::Mat(contours[i]), cHull, false);
+				hull.push_back(cHull);
+			}
+		}
+
+		contours = hull;
+	}
+
+	std::vector<cv::Point> approx;
+
+	// DEBUG ------------------------
+	//cv::Mat pImg = image.clone();
+	//cv::cvtColor(pImg, pImg, CV_Lab2RGB);
+	// DEBUG ------------------------
+
+	// test each contour
+	for( size_t i = 0; i < contours.size(); i++ ) {
+		// approxicv::Mate contour with accuracy proportional
+		// to the contour perimeter
+		approxPolyDP(cv::Mat(contours[i]), approx, arcLength(cv::Mat(contours[i]), true)*0.02, true);
+
+		double cArea = contourArea(cv::Mat(approx));
+
+		// DEBUG ------------------------
+		//if (fabs(cArea) < maxArea)
+		//	fillConvexPoly(pImg, &approx[0], (int)approx.size(), DkUtils::blue);
+		// DEBUG ------------------------
+
+		// square contours should have 4 vertices after approxicv::Mation
+		// relatively large area (to filter out noisy contours)
+		// and be convex.
+		// Note: absolute value of an area is used because
+		// area may be positive or negative - in accordance with the
+		// contour orientation
+		if( approx.size() == 4 &&
+			fabs(cArea) > minArea*scale*scale &&
+			(!maxArea || fabs(cArea) < maxArea*scale*scale) && 
+			isContourConvex(cv::Mat(approx)) ) {
+
+			DkPolyRect cr(approx);
+			//moutc << minArea*scale*scale << " < " << fabs(cArea) << " < " << maxArea*scale*scale << dkendl;
+
+			// if cosines of all angles are small
+			// (all angles are ~90 degree)
+			if(/*cr.maxSide() < std::max(tImg.rows, tImg.cols)*maxSideFactor && */
+				(!maxSide || cr.maxSide() < maxSide*scale) && 
+				cr.getMaxCosine() < 0.3 ) {
+				rects.push_back(cr);
+			}
+		}
+	}
+}
+
 cv::Mat DkPageSegmentation::findRectanglesAlternative(const cv::Mat& img, std::vector<DkPolyRect>& rects) const {
 	PageExtractor extractor;
 	extractor.findPage(img, scale, rects);
@@ -283,38 +296,89 @@ void DkPageSegmentation::filterDuplicates(float overlap, float areaRatio) {
 	filterDuplicates(rects, overlap, areaRatio);
 }
 
+/**
+* Removes rectangles that overlap with a better (smaller max cosine) rectangle.
+* Candidate pairs are found with a sweep over the bounding boxes' x-intervals,
+* pairs whose bounding boxes cannot reach the overlap are rejected before
+* the polygon intersection is computed.
+**/
 void DkPageSegmentation::filterDuplicates(std::vector<DkPolyRect>& rects, float overlap, float areaRatio) const {
 
-	std::vector<int> delIdx;
 	std::sort(rects.rbegin(), rects.rend(), &DkPolyRect::compArea);	// rbegin() -> sort descending
 
-	for (int idx = 0; idx < (int)rects.size(); idx++) {
+	int nRects = (int)rects.size();
+	std::vector<DkBox> boxes(nRects);
+	std::vector<double> areas(nRects);
+
+	for (int idx = 0; idx < nRects; idx++) {
+		boxes[idx] = rects[idx].getBBox();
+		areas[idx] = rects[idx].getArea();
+	}
+
+	// sweep: sort by the left box edge and pair every box with all boxes starting before it ends
+	std::vector<int> xOrder(nRects);
+	for (int idx = 0; idx < nRects; idx++)
+		xOrder[idx] = idx;
+
+	std::sort(xOrder.begin(), xOrder.end(), [&](int l, int r) { return boxes[l].uc.x < boxes[r].uc.x; });
+
+	// candidates[idx] holds all (larger index) rectangles whose bounding box overlaps rects[idx]
+	std::vector<std::vector<int> > candidates(nRects);
+
+	for (int sIdx = 0; sIdx < nRects; sIdx++) {
+
+		const DkBox& sb = boxes[xOrder[sIdx]];
+
+		for (int nIdx = sIdx+1; nIdx < nRects && boxes[xOrder[nIdx]].uc.x <= sb.lc.x; nIdx++) {
+
+			const DkBox& nb = boxes[xOrder[nIdx]];
+
+			if (nb.uc.y > sb.lc.y || sb.uc.y > nb.lc.y)
+				continue;
+
+			int cIdx = std::min(xOrder[sIdx], xOrder[nIdx]);
+			candidates[cIdx].push_back(std::max(xOrder[sIdx], xOrder[nIdx]));
+		}
+	}
+
+	std::vector<bool> deleted(nRects, false);
+	std::vector<int> tmpDelIdx;
+
+	for (int idx = 0; idx < nRects; idx++) {
 
 		// if we already deleted a rectangle, we can safely skip it
-		if (std::find(delIdx.begin(), delIdx.end(), idx) != delIdx.end())
+		if (deleted[idx])
 			continue;
 
 		DkPolyRect& cR = rects[idx];
-		double cA = cR.getArea();
+		double cA = areas[idx];
 
-		std::vector<int> tmpDelIdx;
+		std::vector<int>& cc = candidates[idx];
+		std::sort(cc.begin(), cc.end());	// keep the area order of the exhaustive search
+		tmpDelIdx.clear();
 
-		for (int oIdx = idx+1; oIdx < (int)rects.size(); oIdx++) {
+		for (int oIdx : cc) {
 
 			// if we already deleted a rectangle, we can safely skip it
-			if (idx == oIdx || std::find(delIdx.begin(), delIdx.end(), oIdx) != delIdx.end())
+			if (deleted[oIdx])
 				continue;
 
 			DkPolyRect& oR = rects[oIdx];
-			double oA = oR.getArea();
+			double oA = areas[oIdx];
 
 			// ignore rectangles with totally different area
-			if (oA/cA < areaRatio)	// since we sort, we know that oA is larger
+			if (oA/cA < areaRatio)	// since we sort, all remaining rectangles are even smaller
+				break;
+
+			// the bounding box intersection is an upper bound of the polygon intersection
+			// (slightly relaxed since DkIntersectPoly quantizes the coordinates)
+			double minA = std::min(cA, oA);
+			if (boxes[idx].intersectArea(boxes[oIdx]) < overlap*minA*0.999)
 				continue;
 
 			double intersection = abs(oR.intersectArea(cR));
 
-			if (std::max(intersection/cR.getArea(), intersection/oR.getArea()) > overlap) {
+			if (intersection/minA > overlap) {
 
 				double cVal, oVal;
 
@@ -330,7 +394,7 @@ void DkPageSegmentation::filterDuplicates(std::vector<DkPolyRect>& rects, float
 
 				// delete the rect which has an inferior cosine value
 				if (cVal > oVal) {
-					delIdx.push_back(idx);
+					deleted[idx] = true;
 					tmpDelIdx.clear();
 					break; // we're done if we delete the current rect
 				}
@@ -340,18 +404,19 @@ void DkPageSegmentation::filterDuplicates(std::vector<DkPolyRect>& rects, float
 			}
 		}
 
-		delIdx.insert(delIdx.end(), tmpDelIdx.begin(), tmpDelIdx.end());
+		for (int dIdx : tmpDelIdx)
+			deleted[dIdx] = true;
 	}
 
-	if (!delIdx.empty()) {
-		std::vector<DkPolyRect> filtered;
+	std::vector<DkPolyRect> filtered;
 
-		for (int idx = 0; idx < (int)rects.size(); idx++) {
+	for (int idx = 0; idx < nRects; idx++) {
 
-			if (std::find(delIdx.begin(), delIdx.end(), idx) == delIdx.end())
-				filtered.push_back(rects[idx]);
-		}
+		if (!deleted[idx])
+			filtered.push_back(rects[idx]);
+	}
 
+	if (filtered.size() != rects.size()) {
 		qDebug() << "[DkPageSegmentation] " << rects.size() - filtered.size() << " rectangles removed, remaining: " << filtered.size();
 		rects = filtered;
 	}
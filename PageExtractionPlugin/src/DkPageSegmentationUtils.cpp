@@ -31,6 +31,11 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #pragma warning(pop)		// no warnings from includes - end
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DK_HOUGH_SSE2
+#endif
+
 namespace nmp {
 
 
@@ -453,7 +458,21 @@ void PageExtractor::findPage(cv::Mat img, float scale, std::vector<DkPolyRect>&
 	
 	// find line segments in image
 	int maxGapLength = (int)(maxGapLengthRel * smallerSide);
-	std::vector<LineSegment> lineSegments = findLineSegments(bw, lines, minLineSegmentLength, maxGapLength);
+	std::vector<unsigned char> found;
+	std::vector<LineSegment> lineSegments = findLineSegments(bw, lines, minLineSegmentLength, maxGapLength, found);
+	
+	// drop the hough lines without a segment - lines[i] and lineSegments[i] must describe the same line
+	size_t numFound = 0;
+	for (size_t idx = 0; idx < lines.size(); idx++) {
+		if (found[idx]) {
+			lines[numFound] = lines[idx];
+			lineSegments[numFound] = lineSegments[idx];
+			numFound++;
+		}
+	}
+	lines.resize(numFound);
+	lineSegments.resize(numFound);
+	
 	if (lineSegments.empty()) {
 		qDebug() << "findLineSegments has not found any line segments, even though hough lines were detected.";
 		return;
@@ -569,7 +588,8 @@ float PageExtractor::pointToLineDistance(LineSegment ls, cv::Point2f p) {
 }
 
 /**
- * Hough transform, similar to the OpenCV implementation, returns a vector of the linesMax lines, sorted by accumulator value in descending order. 
+ * Hough transform, similar to the OpenCV implementation, returns a vector of at most linesMax lines, sorted by accumulator value in descending order. 
+ * The edge pixels are collected once, the angles are voted in parallel (each thread owns the accumulator rows of its angles).
  */
 std::vector<PageExtractor::HoughLine> PageExtractor::houghTransform(cv::Mat bwImg, float rho, float theta, int threshold, int linesMax) const {
 	// the implementation is very similar to the one from opencv 2, but it returns the accumulator values and uses some different data structures
@@ -585,36 +605,75 @@ std::vector<PageExtractor::HoughLine> PageExtractor::houghTransform(cv::Mat bwIm
 
 	int numAngle = cvRound(CV_PI / theta) + 2;
 	int numRho = (width + height) * 2 + 2; // always even
-	cv::Mat accum = cv::Mat::zeros(numRho, numAngle, CV_16U);
-	std::vector<double> tabSin(numAngle - 2);
-	std::vector<double> tabCos(numAngle - 2);
+	std::vector<float> tabSin(numAngle - 2);
+	std::vector<float> tabCos(numAngle - 2);
 	
 	float angle = 0.0f;
 	for (int n = 0; n < numAngle - 2; n++, angle += theta) {
-		tabSin[n] = sin(static_cast<double>(angle));
-		tabCos[n] = cos(static_cast<double>(angle));
+		tabSin[n] = (float)(sin(static_cast<double>(angle)) / rho);
+		tabCos[n] = (float)(cos(static_cast<double>(angle)) / rho);
 	}
-	
-	// fill the accumulator
+
+	// collect the edge pixels
+	std::vector<float> xs, ys;
 	for (int i = 0; i < height; i++) {
+
+		const unsigned char* ptr = bwImg.ptr<unsigned char>(i);
+		
 		for (int j = 0; j < width; j++) {
-			if (bwImg.at<unsigned char>(i, j) != 0) {
-				for (int n = 0; n < numAngle - 2; n++) {
-					int r = cvRound((j * tabCos[n] + i * tabSin[n]) / rho) + numRho / 2;
-					accum.at<std::uint16_t>(r + 1, n + 1)++;
-				}
+			if (ptr[j] != 0) {
+				xs.push_back((float)j);
+				ys.push_back((float)i);
 			}
 		}
 	}
+
+	int numPts = (int)xs.size();
+	
+	// fill the accumulator - one row per angle (with a zero border around)
+	std::vector<int> accum(numAngle * numRho, 0);
+
+	cv::parallel_for_(cv::Range(0, numAngle - 2), [&](const cv::Range& range) {
+
+		for (int n = range.start; n < range.end; n++) {
+
+			int* acc = &accum[(n + 1) * numRho + 1 + numRho / 2];
+			float cn = tabCos[n];
+			float sn = tabSin[n];
+			int idx = 0;
+
+#ifdef DK_HOUGH_SSE2
+			__m128 vc = _mm_set1_ps(cn);
+			__m128 vs = _mm_set1_ps(sn);
+			int r[4];
+
+			for (; idx + 4 <= numPts; idx += 4) {
+
+				__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&xs[idx]), vc), _mm_mul_ps(_mm_loadu_ps(&ys[idx]), vs));
+				_mm_storeu_si128((__m128i*)r, _mm_cvtps_epi32(v));	// rounds to nearest like cvRound
+
+				acc[r[0]]++;
+				acc[r[1]]++;
+				acc[r[2]]++;
+				acc[r[3]]++;
+			}
+#endif
+			for (; idx < numPts; idx++)
+				acc[cvRound(xs[idx] * cn + ys[idx] * sn)]++;
+		}
+	});
 	
 	// find local maxima
-	for (int r = 1; r < numRho - 1; r++) {
-		for (int n = 1; n < numAngle - 1; n++) {
-			int val = accum.at<std::uint16_t>(r, n);
-			int valRl = accum.at<std::uint16_t>(r - 1, n);
-			int valRr = accum.at<std::uint16_t>(r + 1, n);
-			int valNl = accum.at<std::uint16_t>(r, n - 1);
-			int valNr = accum.at<std::uint16_t>(r, n + 1);
+	for (int n = 1; n < numAngle - 1; n++) {
+
+		const int* acc = &accum[n * numRho];
+
+		for (int r = 1; r < numRho - 1; r++) {
+			int val = acc[r];
+			int valRl = acc[r - 1];
+			int valRr = acc[r + 1];
+			int valNl = acc[r - numRho];
+			int valNr = acc[r + numRho];
 			if (val > threshold && 
 					val > valRl && val > valRr &&
 					val > valNl  && val > valNr) {
@@ -628,9 +687,15 @@ std::vector<PageExtractor::HoughLine> PageExtractor::houghTransform(cv::Mat bwIm
 		}
 	}
 
-	// sort by accumulator value
-	std::sort(lines.begin(), lines.end(), [] (HoughLine l1, HoughLine l2) { return l1.acc > l2.acc; });
-	lines.resize(linesMax);
+	// sort by accumulator value - only the linesMax strongest peaks are kept
+	auto compAcc = [] (const HoughLine& l1, const HoughLine& l2) { return l1.acc > l2.acc; };
+
+	if ((int)lines.size() > linesMax) {
+		std::partial_sort(lines.begin(), lines.begin() + linesMax, lines.end(), compAcc);
+		lines.resize(linesMax);
+	}
+	else
+		std::sort(lines.begin(), lines.end(), compAcc);
 	
 	return lines;
 }
@@ -644,115 +709,178 @@ double PageExtractor::angleDiff(double a, double b) {
 
 /**
  * Finds the corresponding line segments (the largest ones) to all houghLines in the binary image bwImg.
+ * One segment is returned per hough line, so that houghLines[i] and the i-th segment describe the same line.
  * @param bwImg the binary image on which the hough transform was performed
  * @param houghLines vector of hough lines
  * @param minLength the minimum line length
  * @param maxGap the tolerance for gaps in the line segments
+ * @param found found[i] is 0 if no segment was found for houghLines[i] (its segment is empty then)
  */
-std::vector<PageExtractor::LineSegment> PageExtractor::findLineSegments(cv::Mat bwImg, const std::vector<HoughLine>& houghLines, int minLength, int maxGap) const {
-	std::vector<LineSegment> lineSegments; // final line segments
-	std::vector<LineSegment> lineSegmentsCurrent; // line segments per line
-	LineFindingMode mode;
-	int dimRange = 0;
-	
-	for (HoughLine line : houghLines) {
-		lineSegmentsCurrent.clear();
-		cv::Point2f startPos;
-		bool active = false; // if true: a line is being followed
-		bool inGap = false; // if true: a line is being followed and currently not interrupted
-		cv::Point2f stopPos;
-		cv::Point2f prevPos;
-		int gapCounter = 0;
-		bool notYetInImageRange = true;
+std::vector<PageExtractor::LineSegment> PageExtractor::findLineSegments(cv::Mat bwImg, const std::vector<HoughLine>& houghLines, int minLength, int maxGap, std::vector<unsigned char>& found) const {
+	
+	// the lines are independent - trace them in parallel and keep the longest segment of each
+	std::vector<LineSegment> longestSegments(houghLines.size());
+	found.assign(houghLines.size(), 0);
+	
+	cv::parallel_for_(cv::Range(0, (int)houghLines.size()), [&](const cv::Range& r) {
+		
+		std::vector<LineSegment> lineSegmentsCurrent; // line segments per line
 		
-		// in vertical mode, the x values are calculated for every y
-		if (abs(line.angle - CV_PI / 2) > CV_PI / 4) {
-			mode = LineFindingMode::Vertical;
-			dimRange = bwImg.size().height;
-		} else { // in horizontal mode, the y values are calculated for every x
-			mode = LineFindingMode::Horizontal;
-			dimRange = bwImg.size().width;
+		for (int idx = r.start; idx < r.end; idx++) {
+			
+			traceLine(bwImg, houghLines[idx], minLength, maxGap, lineSegmentsCurrent);
+			
+			// for every line in houghLines add only the longest line (including gaps) that was found in the image
+			if (!lineSegmentsCurrent.empty()) {
+				longestSegments[idx] = *std::max_element(lineSegmentsCurrent.begin(), lineSegmentsCurrent.end(), [] (const LineSegment& l1, const LineSegment& l2) { return l1.length < l2.length; });
+				found[idx] = 1;
+			}
 		}
+	});
+	
+	return longestSegments;
+}
+
+/**
+ * Follows a hough line through the binary image bwImg and returns its line segments.
+ * The line is walked with a fixed-point DDA: the step coordinate (x in horizontal, y in vertical mode) is incremented by one pixel,
+ * the other coordinate is clipped to the image once and its two neighboring pixels are checked with row pointers.
+ * @param bwImg the binary image on which the hough transform was performed
+ * @param line the hough line
+ * @param minLength the minimum line length
+ * @param maxGap the tolerance for gaps in the line segments
+ * @param lineSegments the line segments found (cleared first)
+ */
+void PageExtractor::traceLine(const cv::Mat& bwImg, const HoughLine& line, int minLength, int maxGap, std::vector<LineSegment>& lineSegments) const {
+	
+	lineSegments.clear();
+	
+	const int fpShift = 16;
+	const float fpScale = 1.0f / (1 << fpShift);
+	
+	LineFindingMode mode;
+	int dimRange = 0;	// range of the step coordinate
+	int maxCoord = 0;	// maximum of the computed coordinate
+	double c0, dc;		// computed coordinate = c0 + i * dc
+	
+	// in vertical mode, the x values are calculated for every y
+	if (abs(line.angle - CV_PI / 2) > CV_PI / 4) {
+		mode = LineFindingMode::Vertical;
+		dimRange = bwImg.rows;
+		maxCoord = bwImg.cols - 1;
+		c0 = line.rho / cos(line.angle);
+		dc = -tan(line.angle);
+	} else { // in horizontal mode, the y values are calculated for every x
+		mode = LineFindingMode::Horizontal;
+		dimRange = bwImg.cols;
+		maxCoord = bwImg.rows - 1;
+		c0 = line.rho / sin(line.angle);
+		dc = -1.0 / tan(line.angle);
+	}
+	
+	int64 cFp0 = (int64)cvRound(c0 * (1 << fpShift));
+	int64 dFp = (int64)cvRound(dc * (1 << fpShift));
+	int64 maxFp = (int64)maxCoord << fpShift;
+	
+	auto inRange = [&](int i) {
+		int64 c = cFp0 + i * dFp;
+		return c >= 0 && c <= maxFp;
+	};
+	
+	// clip the line to the image: [iStart, iEnd] are the steps within the image
+	int iStart = 0;
+	int iEnd = dimRange - 1;
+	
+	if (dFp != 0) {
+		double t0 = -(double)cFp0 / dFp;
+		double t1 = (double)(maxFp - cFp0) / dFp;
+		iStart = (int)std::min(std::max(ceil(std::min(t0, t1)), 0.0), (double)dimRange);
+		iEnd = (int)std::max(std::min(floor(std::max(t0, t1)), (double)(dimRange - 1)), -1.0);
+	}
+	
+	// correct rounding errors of the estimate
+	while (iStart <= iEnd && !inRange(iStart))
+		iStart++;
+	while (iStart > 0 && inRange(iStart - 1))
+		iStart--;
+	while (iEnd >= iStart && !inRange(iEnd))
+		iEnd--;
+	while (iEnd < dimRange - 1 && inRange(iEnd + 1))
+		iEnd++;
+	
+	if (iStart > iEnd)
+		return;	// the line does not cross the image
+	
+	auto toPoint = [&](int i) {
+		float c = (float)(cFp0 + i * dFp) * fpScale;
+		return mode == LineFindingMode::Horizontal ? cv::Point2f((float)i, c) : cv::Point2f(c, (float)i);
+	};
+	
+	// the segment is closed at the first step outside the image (or the last step)
+	int iStop = std::min(iEnd + 1, dimRange - 1);
+	
+	int startIdx = 0;
+	int stopIdx = 0;
+	bool active = false; // if true: a line is being followed
+	bool inGap = false; // if true: a line is being followed and currently interrupted
+	int gapCounter = 0;
+	int64 cFp = cFp0 + iStart * dFp;
+	
+	for (int i = iStart; i <= iStop; i++, cFp += dFp) {
 		
-		float x;
-		float y;
-		// go through all x or y values and calculate the corresponding coordinate
-		for (int i = 0; i < dimRange; i++) {
-			if (mode == LineFindingMode::Horizontal) {
-				x = (float)i;
-				y = (line.rho - x * cos(line.angle)) / (sin(line.angle));
-				if (notYetInImageRange && y <= bwImg.rows - 1 && y >= 0) {
-					notYetInImageRange = false;
-				}
-			} else {
-				y = (float)i;;
-				x = (line.rho - y * sin(line.angle)) / (cos(line.angle));
-				if (notYetInImageRange && x <= bwImg.cols - 1 && x >= 0) {
-					notYetInImageRange = false;
+		// close open lines at the end
+		if (i == iStop) {
+			if (active) {
+				LineSegment l;
+				l.p1 = toPoint(startIdx);
+				l.p2 = inGap ? toPoint(stopIdx) : toPoint(i);
+				l.length = (float)cv::norm(l.p1 - l.p2);
+				
+				if (l.length > minLength) {
+					lineSegments.push_back(l);
 				}
 			}
-			if (notYetInImageRange) {
-				continue;
+			break;
+		}
+		
+		// test if the line is on an edge pixel. account for small errors by checking both neighbors
+		int cFloor = (int)(cFp >> fpShift);
+		int cCeil = cFloor + ((cFp & ((1 << fpShift) - 1)) != 0);
+		bool isEdge;
+		
+		if (mode == LineFindingMode::Horizontal)
+			isEdge = bwImg.ptr<unsigned char>(cFloor)[i] != 0 || bwImg.ptr<unsigned char>(cCeil)[i] != 0;
+		else {
+			const unsigned char* ptr = bwImg.ptr<unsigned char>(i);
+			isEdge = ptr[cFloor] != 0 || ptr[cCeil] != 0;
+		}
+		
+		if (isEdge) {
+			if (!active) {
+				startIdx = i;
+				active = true;
 			}
-			
-			// close open lines at the end
-			if (i == dimRange - 1 || x > bwImg.cols - 1 || x < 0 || y > bwImg.rows - 1 || y < 0) {
-				if (active) {
-					LineSegment l;
-					if (!inGap) {
-						l.p1 = startPos;
-						l.p2 = cv::Point2f(x, y);
-					} else {
-						l.p1 = startPos;
-						l.p2 = stopPos;
-					}
-					
-					l.length = (float)cv::norm(l.p1 - l.p2);
-					if (l.length > minLength) {
-						lineSegmentsCurrent.push_back(l);
-					}
-				}
-				break;
+			inGap = false;
+		} else { // position is not an edge pixel
+			// assume that the line segment is just interrupted (we are in a gap)
+			if (!inGap) {
+				gapCounter = 0;
+				inGap = true;
+				stopIdx = i - 1;
 			}
-			
-			// test if (x, y) is an edge pixel. account for small errors by checking all possible positions
-			if (bwImg.at<unsigned char>((int) ceil(y), (int) ceil(x)) != 0 ||
-					bwImg.at<unsigned char>((int) ceil(y), (int) floor(x)) != 0 || 
-					bwImg.at<unsigned char>((int) floor(y), (int) ceil(x)) != 0 ||
-					bwImg.at<unsigned char>((int) floor(y), (int) floor(x)) != 0) {
+			gapCounter++;
+			// if the gap is too large, the line segment gets closed
+			if (gapCounter >= maxGap && active) {
+				cv::Point2f startPos = toPoint(startIdx);
+				cv::Point2f stopPos = toPoint(stopIdx);
 				
-				if (!active) {
-					startPos = cv::Point2f(x, y);
-					active = true;
-				}
-				inGap = false;
-			} else { // position is not an edge pixel
-				// assume that the line segment is just interrupted (we are in a gap)
-				if (!inGap) {
-					gapCounter = 0;
-					inGap = true;
-					stopPos = prevPos;
-				}
-				gapCounter++;
-				// if the gap is too large, the line segment gets closed
-				if (gapCounter >= maxGap && active) {
-					if (cv::norm(stopPos - startPos) > minLength) {
-						lineSegmentsCurrent.push_back(LineSegment {startPos, stopPos, static_cast<float>(cv::norm(stopPos - startPos))});
-					}
-					active = false;
+				if (cv::norm(stopPos - startPos) > minLength) {
+					lineSegments.push_back(LineSegment {startPos, stopPos, static_cast<float>(cv::norm(stopPos - startPos))});
 				}
+				active = false;
 			}
-			prevPos = cv::Point2f(x, y);
-		}
-		
-		// for every line in houghLines add only the longest line (including gaps) that was found in the image
-		if (!lineSegmentsCurrent.empty()) {
-			auto longestLineSegmentIt = std::max_element(lineSegmentsCurrent.begin(), lineSegmentsCurrent.end(), [] (LineSegment l1, LineSegment l2) { return l1.length < l2.length; });
-			lineSegments.push_back(*longestLineSegmentIt);
 		}
 	}
-	
-	return lineSegments;
 }
 
 PageExtractor::ExtendedPeak::ExtendedPeak(const HoughLine& line1, const LineSegment& ls1, const HoughLine& line2, const LineSegment& ls2)
@@ -791,8 +919,30 @@ std::pair<bool, cv::Point2f> PageExtractor::findLineIntersection(const LineSegme
 	return std::pair<bool, cv::Point2f>(r, cv::Point2f(x));
 }
 
+/**
+ * Returns the octant (0 - 7) of atan2(y, x) in [0, 2pi) - each octant covers [i*pi/4, (i+1)*pi/4).
+ */
+static inline int gradientOctant(int y, int x) {
+
+	if (y > 0 || (y == 0 && x > 0)) {	// [0, pi)
+		if (x > 0)
+			return (y >= x) ? 1 : 0;
+		else
+			return (y > -x) ? 2 : 3;
+	}
+	else {								// [pi, 2pi)
+		if (x < 0)
+			return (-y >= -x) ? 5 : 4;
+		else
+			return (x >= -y) ? 7 : 6;
+	}
+}
+
 /**
  * Generates an edge image of gray, tries to remove small text-like structures and returns it.
+ * Edges are decomposed into 8 gradient orientation planes, pixels whose (dilated) neighborhood
+ * contains more than threshold orientations are considered as text.
+ * The orientations are stored as one bit per pixel so that a single OR dilation counts the orientations of all planes.
  */
 cv::Mat PageExtractor::removeText(cv::Mat gray, float sigma, int selemSize, int threshold) {
 	
@@ -801,61 +951,119 @@ cv::Mat PageExtractor::removeText(cv::Mat gray, float sigma, int selemSize, int
 		return gray;
 	}
 	
-	static const float eps = 0.001f;
 	cv::Mat bw;
 	cv::Mat sobel_h;
 	cv::Mat sobel_v;
-	cv::Mat sobel_angle = cv::Mat::zeros(gray.size(), CV_32F);
 	cv::GaussianBlur(gray, gray, cv::Size((int)(2 * floor(sigma * 3) + 1), (int)(2 * floor(sigma * 3) + 1)), sigma);
 	cv::Canny(gray, bw, 0.1 * 255, 0.2 * 255);
-	cv::Sobel(gray, sobel_h, CV_32F, 0, 1, 3);
-	cv::Sobel(gray, sobel_v, CV_32F, 1, 0, 3);
-	
-	for (int i = 0; i < sobel_angle.rows; i++) {
-		for (int j = 0; j < sobel_angle.cols; j++) {
-			// calculate gradient angle
-			float angle = (atan2(sobel_v.at<float>(i, j), sobel_h.at<float>(i, j)));
-			// shift [-pi, 0] to [pi, 2pi]
-			if (angle < 0.0f) {
-				angle += (float)(2.0f * CV_PI);
+	cv::Sobel(gray, sobel_h, CV_16S, 0, 1, 3);	// integer gradients are exact for 8 bit images
+	cv::Sobel(gray, sobel_v, CV_16S, 1, 0, 3);
+	
+	// edge plane decomposition
+	cv::Mat selem = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2 * selemSize, 2 * selemSize));
+	cv::Point anchor(selem.cols / 2, selem.rows / 2);
+	
+	// the orientation bit of every edge pixel (pixels without gradient are no edges)
+	// the border is zero padded for the dilation
+	cv::Mat E = cv::Mat::zeros(gray.rows + selem.rows - 1, gray.cols + selem.cols - 1, CV_8U);
+	
+	cv::parallel_for_(cv::Range(0, gray.rows), [&](const cv::Range& r) {
+	
+		for (int i = r.start; i < r.end; i++) {
+	
+			const short* sh = sobel_h.ptr<short>(i);
+			const short* sv = sobel_v.ptr<short>(i);
+			const unsigned char* bwPtr = bw.ptr<unsigned char>(i);
+			unsigned char* ePtr = E.ptr<unsigned char>(i + anchor.y) + anchor.x;
+	
+			for (int j = 0; j < gray.cols; j++) {
+	
+				if (bwPtr[j] && (sh[j] || sv[j]))
+					ePtr[j] = (unsigned char)(1 << gradientOctant(sv[j], sh[j]));
+			}
+		}
+	});
+	
+	// column span of every structuring element row (the ellipse is convex)
+	std::vector<int> spanStart(selem.rows, -1);
+	std::vector<int> spanWidth(selem.rows, 0);
+	
+	for (int i = 0; i < selem.rows; i++) {
+		for (int j = 0; j < selem.cols; j++) {
+			if (selem.at<unsigned char>(i, j)) {
+				if (spanStart[i] == -1)
+					spanStart[i] = j;
+				spanWidth[i] = j - spanStart[i] + 1;
 			}
-			// set 2pi to 0
-			if (angle >= 2 * CV_PI) {
-				angle = 0.0f;
+		}
+	}
+	
+	// horizontal OR of every span width
+	std::vector<cv::Mat> E_or(selem.cols + 1);
+	for (int w : spanWidth) {
+		if (w > 0 && E_or[w].empty())
+			E_or[w].create(E.size(), CV_8U);
+	}
+	
+	cv::parallel_for_(cv::Range(0, E.rows), [&](const cv::Range& r) {
+	
+		std::vector<unsigned char> acc(E.cols);
+	
+		for (int i = r.start; i < r.end; i++) {
+	
+			const unsigned char* ePtr = E.ptr<unsigned char>(i);
+			std::copy(ePtr, ePtr + E.cols, acc.begin());
+	
+			for (int w = 1; w < (int)E_or.size(); w++) {
+	
+				for (int j = 0; j + w <= E.cols; j++)
+					acc[j] |= ePtr[j + w - 1];
+	
+				if (!E_or[w].empty())
+					std::copy(acc.begin(), acc.end(), E_or[w].ptr<unsigned char>(i));
 			}
-			sobel_angle.at<float>(i, j) = angle;
 		}
+	});
+	
+	// remove text regions: keep edges where at most threshold orientations are dilated into
+	unsigned char keep[256];
+	for (int m = 0; m < 256; m++) {
+		int bits = 0;
+		for (int b = 0; b < 8; b++)
+			bits += (m >> b) & 1;
+		keep[m] = bits <= threshold ? 255 : 0;
 	}
 	
-	// edge plane decomposition
+	cv::Mat E_hat(gray.size(), CV_8U);
+	
+	cv::parallel_for_(cv::Range(0, gray.rows), [&](const cv::Range& r) {
+	
+		std::vector<unsigned char> H(gray.cols);
+	
+		for (int i = r.start; i < r.end; i++) {
+	
+			std::fill(H.begin(), H.end(), (unsigned char)0);
+	
+			for (int k = 0; k < selem.rows; k++) {
+	
+				if (!spanWidth[k])
+					continue;
+	
+				const unsigned char* oPtr = E_or[spanWidth[k]].ptr<unsigned char>(i + k) + spanStart[k];
+	
+				for (int j = 0; j < gray.cols; j++)
+					H[j] |= oPtr[j];
+			}
+	
+			const unsigned char* ePtr = E.ptr<unsigned char>(i + anchor.y) + anchor.x;
+			unsigned char* hatPtr = E_hat.ptr<unsigned char>(i);
+	
+			for (int j = 0; j < gray.cols; j++)
+				hatPtr[j] = ePtr[j] ? keep[H[j]] : 0;
+		}
+	});
 	
-	std::vector<cv::Mat> E_i(8);
-	std::vector<cv::Mat> E_i_ex(8);
-	cv::Mat H = cv::Mat::zeros(gray.size(), CV_8U);
-	cv::Mat mask;
-	cv::Mat mask_factor = (cv::abs(sobel_h) > eps | cv::abs(sobel_v) > eps);
-	cv::Mat M_text_inv;
-	float rangeStart;
-	float rangeEnd;
-	// go through angles in pi/4 steps
-	for (int i = 0; i < 8; i++) {
-		rangeStart = (float)(CV_PI / 4.0f * i);
-		rangeEnd = (float)(CV_PI / 4.0f * (i + 1));
-		mask = ((sobel_angle >= rangeStart) & (sobel_angle < rangeEnd)) & mask_factor;
-		E_i[i] = mask & bw;
-		cv::dilate(E_i[i], E_i_ex[i], cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2 * selemSize, 2 * selemSize)));
-		cv::threshold(E_i_ex[i], E_i_ex[i], 1, 1, cv::THRESH_TRUNC); // E_i_ex is binary, true pixels are 255, we have to truncate them to 1
-		H += E_i_ex[i];
-	}
-	
-	// remove text regions
-	M_text_inv = H <= threshold;
-	cv::Mat E_i_hat = cv::Mat::zeros(bw.size(), CV_8U);
-	for (int i = 0; i < 8; i++) {
-		E_i_hat = E_i_hat | (E_i[i] & M_text_inv); // equals (E_i[i] AND M_text) XOR E_i[i]
-	}
-	
-	return E_i_hat;
+	return E_hat;
 }
 
 };
@@ -319,14 +319,14 @@ public:
 
 	float intersectArea(const DkBox& box) const {
 
-		nmc::DkVector tmp1 = lc.maxVec(box.lc);
+		nmc::DkVector tmp1 = lc.minVec(box.lc);
 		nmc::DkVector tmp2 = uc.maxVec(box.uc);
 
 		// no intersection?
-		if (lc.x < uc.x || lc.y < lc.y)
+		if (tmp1.x < tmp2.x || tmp1.y < tmp2.y)
 			return 0;
 
-		tmp1 = tmp2-tmp1;
+		tmp1 = tmp1-tmp2;
 
 		return tmp1.width*tmp1.height;
 	};
@@ -518,7 +518,8 @@ protected:
 	static float pointToLineDistance(LineSegment ls, cv::Point2f p);
 	static cv::Mat removeText(cv::Mat gray, float sigma, int selemSize, int threshold = 2);
 	std::vector<HoughLine> houghTransform(cv::Mat bwImg, float rho, float theta, int threshold, int linesMax) const;
-	std::vector<LineSegment> findLineSegments(cv::Mat bwImg, const std::vector<HoughLine>& houghLines, int minLength, int maxGap) const;
+	std::vector<LineSegment> findLineSegments(cv::Mat bwImg, const std::vector<HoughLine>& houghLines, int minLength, int maxGap, std::vector<unsigned char>& found) const;
+	void traceLine(const cv::Mat& bwImg, const HoughLine& line, int minLength, int maxGap, std::vector<LineSegment>& lineSegments) const;
 };
 
 };
@@ -0,0 +1,197 @@
+/*******************************************************************************************************
+ DkThresholdBatchPlugin.cpp
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkThresholdBatchPlugin.h"
+
+#include "DkSettings.h"
+#include "DkImageContainer.h"
+
+#include <QUuid>
+
+namespace nmp {
+
+/**
+*	Constructor
+**/
+DkThresholdBatchPlugin::DkThresholdBatchPlugin() {
+
+	// create run IDs
+	QVector<QString> runIds;
+	runIds.resize(id_end);
+
+	for (int idx = 0; idx < id_end; idx++)
+		runIds[idx] = QUuid::createUuid().toString();
+	mRunIDs = runIds.toList();
+
+	// create menu actions
+	QVector<QString> menuNames;
+	menuNames.resize(id_end);
+
+	menuNames[id_threshold] = tr("Threshold");
+	mMenuNames = menuNames.toList();
+
+	// create menu status tips
+	QVector<QString> statusTips;
+	statusTips.resize(id_end);
+
+	statusTips[id_threshold] = tr("Thresholds the image with the last applied channel, range and auto method.");
+	mMenuStatusTips = statusTips.toList();
+
+	// save default settings
+	loadSettings(nmc::DkSettingsManager::instance().qSettings());
+	saveSettings(nmc::DkSettingsManager::instance().qSettings());
+}
+
+/**
+* Returns unique ID for the generated dll
+**/
+QString DkThresholdBatchPlugin::id() const {
+	return PLUGIN_ID;
+};
+
+/**
+* Returns descriptive image
+**/
+QImage DkThresholdBatchPlugin::image() const {
+
+	return QImage(":/nomacsPluginThrBatch/img/description.png");
+}
+
+QString DkThresholdBatchPlugin::version() const {
+	return PLUGIN_VERSION;
+}
+
+QString DkThresholdBatchPlugin::name() const {
+	return "Threshold Batch";
+}
+
+QList<QAction*> DkThresholdBatchPlugin::createActions(QWidget* parent) {
+
+	if (mActions.empty()) {
+
+		for (int idx = 0; idx < id_end; idx++) {
+			QAction* ca = new QAction(mMenuNames[idx], parent);
+			ca->setObjectName(mMenuNames[idx]);
+			ca->setStatusTip(mMenuStatusTips[idx]);
+			ca->setData(mRunIDs[idx]);	// runID needed for calling function runPlugin()
+			mActions.append(ca);
+		}
+	}
+
+	return mActions;
+}
+
+QList<QAction*> DkThresholdBatchPlugin::pluginActions() const {
+
+	return mActions;
+}
+
+/**
+* Main function: thresholds the image with the stored settings
+* @param plugin ID
+* @param image to be processed
+**/
+QSharedPointer<nmc::DkImageContainer> DkThresholdBatchPlugin::runPlugin(
+	const QString &runID,
+	QSharedPointer<nmc::DkImageContainer> imgC,
+	const nmc::DkSaveInfo&,
+	QSharedPointer<nmc::DkBatchInfo>&) const {
+
+	if (runID != mRunIDs[id_threshold] || !imgC)
+		return imgC;
+
+	QImage thrImg = thresholdImage(imgC->image());
+
+	if (thrImg.isNull())
+		return QSharedPointer<nmc::DkImageContainer>();	// notify parent
+
+	imgC->setImage(thrImg, tr("Thresholded"));
+
+	return imgC;
+}
+
+/**
+* Reloads the values the threshold viewport stored since the plugin was created.
+**/
+void DkThresholdBatchPlugin::preLoadPlugin() const {
+
+	readSettings(nmc::DkSettingsManager::instance().qSettings());
+}
+
+/**
+* Thresholds an image with the batch settings.
+* The engine is local, so concurrent batch workers do not share any buffers.
+**/
+QImage DkThresholdBatchPlugin::thresholdImage(const QImage& img) const {
+
+	DkThresholdEngine engine;
+	engine.setChannel(mChannel);
+	engine.setRange(mLower, mUpper);
+	engine.setImage(img);
+
+	if (DkThresholdEngine::isAdaptive(mMethod))
+		engine.setAdaptiveMethod(mMethod);
+	else if (mMethod != DkThresholdEngine::method_end) {
+		int thr = engine.globalThreshold(mMethod);
+
+		if (thr >= 0)
+			engine.setRange(thr, mUpper);
+	}
+
+	return engine.threshold();
+}
+
+void DkThresholdBatchPlugin::loadSettings(QSettings & settings) {
+
+	readSettings(settings);
+}
+
+void DkThresholdBatchPlugin::readSettings(QSettings & settings) const {
+
+	settings.beginGroup("Threshold Plugin");
+	int channel = settings.value("Channel", mChannel).toInt();
+	if (channel >= 0 && channel < DkThresholdEngine::channel_end)
+		mChannel = channel;
+	mLower = qBound(0, settings.value("Lower", mLower).toInt(), 255);
+	mUpper = qBound(mLower, settings.value("Upper", mUpper).toInt(), 255);
+	int method = settings.value("Method", mMethod).toInt();
+	if (method >= 0 && method <= DkThresholdEngine::method_end)
+		mMethod = method;
+	settings.endGroup();
+}
+
+void DkThresholdBatchPlugin::saveSettings(QSettings & settings) const {
+
+	settings.beginGroup("Threshold Plugin");
+	settings.setValue("Channel", mChannel);
+	settings.setValue("Lower", mLower);
+	settings.setValue("Upper", mUpper);
+	settings.setValue("Method", mMethod);
+	settings.endGroup();
+}
+
+};
@@ -0,0 +1,98 @@
+/*******************************************************************************************************
+ DkThresholdBatchPlugin.h
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include <QObject>
+#include <QtPlugin>
+#include <QImage>
+#include <QStringList>
+#include <QString>
+#include <QAction>
+#include <QSettings>
+
+#include "DkPluginInterface.h"
+
+#include "DkThresholdEngine.h"
+
+namespace nmp {
+
+/**
+*	Applies the values last applied in the threshold plugin to each image.
+**/
+class DkThresholdBatchPlugin : public QObject, nmc::DkBatchPluginInterface {
+	Q_OBJECT
+	Q_INTERFACES(nmc::DkBatchPluginInterface)
+	Q_PLUGIN_METADATA(IID "com.nomacs.ImageLounge.DkThresholdBatchPlugin/3.3" FILE "DkThresholdBatchPlugin.json")
+
+public:
+	DkThresholdBatchPlugin();
+
+	enum {
+		id_threshold,
+
+		id_end
+	};
+
+	QString id() const override;
+	QImage image() const override;
+	QString version() const;
+	QString name() const;
+
+	QList<QAction*> createActions(QWidget* parent) override;
+	QList<QAction*> pluginActions() const override;
+
+	QSharedPointer<nmc::DkImageContainer> runPlugin(
+		const QString &runID,
+		QSharedPointer<nmc::DkImageContainer> image,
+		const nmc::DkSaveInfo& saveInfo,
+		QSharedPointer<nmc::DkBatchInfo>& batchInfo) const override;
+
+	int interfaceType() const override { return interface_batch; };
+	void preLoadPlugin() const override;	// is called before batch processing
+	virtual void postLoadPlugin(const QVector<QSharedPointer<nmc::DkBatchInfo> > &) const {};	// is called after batch processing
+
+	void loadSettings(QSettings& settings) override;
+	void saveSettings(QSettings& settings) const override;
+
+protected:
+	void readSettings(QSettings& settings) const;
+	QImage thresholdImage(const QImage& img) const;
+
+	QList<QAction*> mActions;
+	QStringList mRunIDs;
+	QStringList mMenuNames;
+	QStringList mMenuStatusTips;
+
+	// the threshold viewport may store new values between two batch runs
+	mutable int mChannel = DkThresholdEngine::channel_gray;
+	mutable int mLower = 128;
+	mutable int mUpper = 255;
+	mutable int mMethod = DkThresholdEngine::method_end;	// method_end: the range is used as is
+};
+
+};
@@ -0,0 +1,850 @@
+/*******************************************************************************************************
+ DkThresholdEngine.cpp
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkThresholdEngine.h"
+#include "DkThresholdUtils.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QtConcurrentMap>
+#pragma warning(pop)		// no warnings from includes - end
+
+#include <cmath>
+
+namespace nmp {
+
+namespace {
+
+// same weights as qGray()
+inline int grayValue(int r, int g, int b) {
+	return (r * 11 + g * 16 + b * 5) >> 5;
+}
+
+inline QRgb grayPixel(uchar val, QRgb alpha) {
+	return alpha | (val << 16) | (val << 8) | val;
+}
+
+/**
+* Calls f(bandIdx, rowStart, rowEnd) for all row bands of an image with the given size.
+* The bands are processed concurrently - bands that did not start yet are skipped if abort is set.
+**/
+template <typename Func>
+void processBands(const QSize& size, const QAtomicInt* abort, Func f) {
+
+	int bh = bandHeight(size);
+
+	QVector<int> bands;
+	for (int y = 0; y < size.height(); y += bh)
+		bands << bands.size();
+
+	if (bands.size() == 1) {
+		f(0, 0, size.height());
+		return;
+	}
+
+	QtConcurrent::blockingMap(bands, [&](const int& bandIdx) {
+
+		if (abort && abort->load())
+			return;
+
+		int rowStart = bandIdx * bh;
+		f(bandIdx, rowStart, qMin(rowStart + bh, size.height()));
+	});
+}
+
+#ifdef DK_THR_SSE2
+inline __m128i channelValue(__m128i p, int channel) {
+
+	const __m128i byteMask = _mm_set1_epi32(0xff);
+
+	switch (channel) {
+	case DkThresholdEngine::channel_red:	return _mm_and_si128(_mm_srli_epi32(p, 16), byteMask);
+	case DkThresholdEngine::channel_green:	return _mm_and_si128(_mm_srli_epi32(p, 8), byteMask);
+	case DkThresholdEngine::channel_blue:	return _mm_and_si128(p, byteMask);
+	}
+
+	// gray: the 16 bit multiplication is safe since each lane is < 256 * 16
+	__m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), byteMask);
+	__m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), byteMask);
+	__m128i b = _mm_and_si128(p, byteMask);
+
+	__m128i sum = _mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(11)), _mm_slli_epi32(g, 4));
+	sum = _mm_add_epi32(sum, _mm_mullo_epi16(b, _mm_set1_epi32(5)));
+
+	return _mm_srli_epi32(sum, 5);
+}
+#endif
+
+#ifdef DK_THR_AVX2
+// expands 8 gray values to 8 opaque gray QRgb values
+inline __m256i expandGray(__m128i v) {
+
+	__m256i v32 = _mm256_cvtepu8_epi32(v);
+	return _mm256_or_si256(_mm256_mullo_epi32(v32, _mm256_set1_epi32(0x010101)), _mm256_set1_epi32((int)0xff000000));
+}
+#endif
+
+// channel extraction --------------------------------------------------------------------
+
+// indexed images are mapped through the color table
+void extractRowIndexed8(const uchar* src, uchar* dst, int width, const uchar* colorLut) {
+
+	for (int x = 0; x < width; x++)
+		dst[x] = colorLut[src[x]];
+}
+
+void extractRow24(const uchar* src, uchar* dst, int width, int channel) {
+
+	const uchar* srcEnd = src + 3 * width;
+
+	// RGB888 is stored byte wise: R G B
+	if (channel == DkThresholdEngine::channel_gray) {
+		for (; src < srcEnd; src += 3, dst++)
+			*dst = (uchar)grayValue(src[0], src[1], src[2]);
+	}
+	else {
+		int offset = channel == DkThresholdEngine::channel_red ? 0 : (channel == DkThresholdEngine::channel_green ? 1 : 2);
+
+		for (; src < srcEnd; src += 3, dst++)
+			*dst = src[offset];
+	}
+}
+
+void extractRow32(const QRgb* src, uchar* dst, int width, int channel) {
+
+	int x = 0;
+
+#ifdef DK_THR_SSE2
+	for (; x <= width - 16; x += 16) {
+
+		__m128i v0 = channelValue(_mm_loadu_si128((const __m128i*)(src + x)), channel);
+		__m128i v1 = channelValue(_mm_loadu_si128((const __m128i*)(src + x + 4)), channel);
+		__m128i v2 = channelValue(_mm_loadu_si128((const __m128i*)(src + x + 8)), channel);
+		__m128i v3 = channelValue(_mm_loadu_si128((const __m128i*)(src + x + 12)), channel);
+
+		// 4 x 4 x 32 bit -> 16 x 8 bit (all values are < 256)
+		__m128i v = _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3));
+		_mm_storeu_si128((__m128i*)(dst + x), v);
+	}
+#endif
+
+	for (; x < width; x++) {
+
+		QRgb p = src[x];
+
+		switch (channel) {
+		case DkThresholdEngine::channel_red:	dst[x] = (uchar)qRed(p);	break;
+		case DkThresholdEngine::channel_green:	dst[x] = (uchar)qGreen(p);	break;
+		case DkThresholdEngine::channel_blue:	dst[x] = (uchar)qBlue(p);	break;
+		default:								dst[x] = (uchar)grayValue(qRed(p), qGreen(p), qBlue(p));
+		}
+	}
+}
+
+void histogramRow(const uchar* src, int width, qint64* hist) {
+
+	for (int x = 0; x < width; x++)
+		hist[src[x]]++;
+}
+
+// thresholding --------------------------------------------------------------------
+
+void thresholdRowGray8(const uchar* src, QRgb* dst, int width, const QRgb* lut32, int lower, int upper, bool enabled) {
+
+	int x = 0;
+
+#ifdef DK_THR_AVX2
+	const __m256i lo256 = _mm256_set1_epi8((char)lower);
+	const __m256i hi256 = _mm256_set1_epi8((char)upper);
+
+	for (; x <= width - 32; x += 32) {
+
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + x));
+
+		// lower <= v <= upper (unsigned)
+		if (enabled)
+			v = _mm256_and_si256(
+				_mm256_cmpeq_epi8(_mm256_max_epu8(v, lo256), v),
+				_mm256_cmpeq_epi8(_mm256_min_epu8(v, hi256), v));
+
+		__m128i vl = _mm256_castsi256_si128(v);
+		__m128i vh = _mm256_extracti128_si256(v, 1);
+
+		_mm256_storeu_si256((__m256i*)(dst + x), expandGray(vl));
+		_mm256_storeu_si256((__m256i*)(dst + x + 8), expandGray(_mm_srli_si128(vl, 8)));
+		_mm256_storeu_si256((__m256i*)(dst + x + 16), expandGray(vh));
+		_mm256_storeu_si256((__m256i*)(dst + x + 24), expandGray(_mm_srli_si128(vh, 8)));
+	}
+#endif
+
+#ifdef DK_THR_SSE2
+	const __m128i lo = _mm_set1_epi8((char)lower);
+	const __m128i hi = _mm_set1_epi8((char)upper);
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+
+	for (; x <= width - 16; x += 16) {
+
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+
+		if (enabled)
+			v = _mm_and_si128(
+				_mm_cmpeq_epi8(_mm_max_epu8(v, lo), v),
+				_mm_cmpeq_epi8(_mm_min_epu8(v, hi), v));
+
+		// gray -> gray gray gray alpha
+		__m128i v16l = _mm_unpacklo_epi8(v, v);
+		__m128i v16h = _mm_unpackhi_epi8(v, v);
+
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_unpacklo_epi16(v16l, v16l), alpha));
+		_mm_storeu_si128((__m128i*)(dst + x + 4), _mm_or_si128(_mm_unpackhi_epi16(v16l, v16l), alpha));
+		_mm_storeu_si128((__m128i*)(dst + x + 8), _mm_or_si128(_mm_unpacklo_epi16(v16h, v16h), alpha));
+		_mm_storeu_si128((__m128i*)(dst + x + 12), _mm_or_si128(_mm_unpackhi_epi16(v16h, v16h), alpha));
+	}
+#else
+	Q_UNUSED(lower);
+	Q_UNUSED(upper);
+	Q_UNUSED(enabled);
+#endif
+
+	for (; x < width; x++)
+		dst[x] = lut32[src[x]];
+}
+
+// copies the alpha channel of src to the (opaque) thresholded row
+void alphaRow(const QRgb* src, QRgb* dst, int width) {
+
+	int x = 0;
+
+#ifdef DK_THR_SSE2
+	const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+
+	for (; x <= width - 4; x += 4) {
+		__m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i*)(src + x)), rgbMask);
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + x));
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_and_si128(d, a));
+	}
+#endif
+
+	for (; x < width; x++)
+		dst[x] &= src[x] | 0x00ffffff;
+}
+
+void thresholdRow24(const uchar* src, uchar* dst, int width, const uchar* lut) {
+
+	for (int x = 0; x < width; x++, dst += 3)
+		dst[0] = dst[1] = dst[2] = lut[src[x]];
+}
+
+// global thresholds --------------------------------------------------------------------
+// all of them return the lowest value that is considered foreground (or -1)
+
+int meanThreshold(const QVector<qint64>& hist) {
+
+	double sumPixel = 0;
+	qint64 numPixel = 0;
+
+	for (int idx = 0; idx < hist.size(); idx++) {
+		sumPixel += (double)idx * hist[idx];
+		numPixel += hist[idx];
+	}
+
+	return numPixel > 0 ? qRound(sumPixel / numPixel) : -1;
+}
+
+/**
+* Otsu's method: maximizes the between class variance.
+**/
+int otsuThreshold(const QVector<qint64>& hist) {
+
+	double total = 0;
+	double sumAll = 0;
+
+	for (int idx = 0; idx < hist.size(); idx++) {
+		total += hist[idx];
+		sumAll += (double)idx * hist[idx];
+	}
+
+	double wB = 0;
+	double sumB = 0;
+	double maxVar = -1;
+	int thr = 0;
+
+	for (int idx = 0; idx < hist.size(); idx++) {
+
+		wB += hist[idx];
+		if (wB == 0)
+			continue;
+
+		double wF = total - wB;
+		if (wF == 0)
+			break;
+
+		sumB += (double)idx * hist[idx];
+
+		double mB = sumB / wB;
+		double mF = (sumAll - sumB) / wF;
+		double var = wB * wF * (mB - mF) * (mB - mF);
+
+		if (var > maxVar) {
+			maxVar = var;
+			thr = idx;
+		}
+	}
+
+	// a single gray value - nothing to separate
+	if (maxVar < 0)
+		return -1;
+
+	return qMin(thr + 1, 255);
+}
+
+/**
+* Zack's triangle method: a line is drawn from the histogram's peak to the end of
+* its longer tail - the bin with the largest distance to that line is the threshold.
+**/
+int triangleThreshold(const QVector<qint64>& hist) {
+
+	int left = 0;
+	int right = hist.size() - 1;
+
+	while (left < hist.size() && hist[left] == 0)
+		left++;
+
+	if (left == hist.size())
+		return -1;
+
+	while (right > 0 && hist[right] == 0)
+		right--;
+
+	int peak = left;
+	for (int idx = left; idx <= right; idx++) {
+		if (hist[idx] > hist[peak])
+			peak = idx;
+	}
+
+	int end = (peak - left > right - peak) ? left : right;
+
+	if (end == peak)
+		return -1;
+
+	// the vertical distance is proportional to the perpendicular distance
+	double slope = (double)(hist[end] - hist[peak]) / (end - peak);
+	double maxDist = 0;
+	int thr = peak;
+
+	for (int idx = qMin(peak, end); idx <= qMax(peak, end); idx++) {
+
+		double dist = hist[peak] + slope * (idx - peak) - hist[idx];
+
+		if (dist > maxDist) {
+			maxDist = dist;
+			thr = idx;
+		}
+	}
+
+	return qMin(thr + 1, 255);
+}
+
+}
+
+DkThresholdEngine::DkThresholdEngine() {
+
+	thrChannel = channel_gray;
+	thrLower = 128;
+	thrUpper = 255;
+	thrEnabled = true;
+	thrAdaptive = method_end;
+	lut.resize(256);
+	stats.resize(channel_end);
+
+	updateLut();
+}
+
+/**
+* Sets the image and extracts the plane of the current channel.
+* @param img the image to be thresholded
+**/
+void DkThresholdEngine::setImage(const QImage& img) {
+
+	src = prepareSource(img);
+	stats.fill(DkThresholdStats());
+
+	computePlane(planeIndex(thrChannel));
+
+	if (isAdaptive(thrAdaptive))
+		computeIntegrals(planeIndex(thrChannel));
+}
+
+QImage DkThresholdEngine::image() const {
+	return src;
+}
+
+/**
+* Sets the channel - its plane is extracted if it is not cached yet.
+**/
+void DkThresholdEngine::setChannel(int channel) {
+
+	if (channel < 0 || channel >= channel_end)
+		channel = channel_gray;
+
+	thrChannel = channel;
+	computePlane(planeIndex(thrChannel));
+
+	if (isAdaptive(thrAdaptive))
+		computeIntegrals(planeIndex(thrChannel));
+}
+
+void DkThresholdEngine::setRange(int lower, int upper) {
+
+	thrLower = qBound(0, lower, 255);
+	thrUpper = qBound(0, upper, 255);
+	updateLut();
+}
+
+void DkThresholdEngine::setEnabled(bool enabled) {
+
+	thrEnabled = enabled;
+	updateLut();
+}
+
+int DkThresholdEngine::channel() const {
+	return thrChannel;
+}
+
+int DkThresholdEngine::lower() const {
+	return thrLower;
+}
+
+int DkThresholdEngine::upper() const {
+	return thrUpper;
+}
+
+bool DkThresholdEngine::isEnabled() const {
+	return thrEnabled;
+}
+
+bool DkThresholdEngine::isAdaptive(int method) {
+	return method == method_niblack || method == method_sauvola;
+}
+
+/**
+* Enables adaptive thresholding (Niblack or Sauvola).
+* Any other method switches back to the global threshold range.
+* The integral images of the current channel are computed if they are not cached yet.
+**/
+void DkThresholdEngine::setAdaptiveMethod(int method) {
+
+	thrAdaptive = isAdaptive(method) ? method : method_end;
+
+	if (isAdaptive(thrAdaptive))
+		computeIntegrals(planeIndex(thrChannel));
+}
+
+int DkThresholdEngine::adaptiveMethod() const {
+	return thrAdaptive;
+}
+
+/**
+* Returns the 256 bin histogram of the current channel.
+* It is empty if no image is set.
+**/
+QVector<qint64> DkThresholdEngine::histogram() const {
+
+	return stats[planeIndex(thrChannel)].histogram;
+}
+
+/**
+* Computes a global threshold from the cached histogram.
+* Pixels with values >= the threshold are foreground.
+* @param method one of method_mean, method_otsu or method_triangle
+* @return the threshold or -1 if it cannot be computed
+**/
+int DkThresholdEngine::globalThreshold(int method) const {
+
+	QVector<qint64> hist = histogram();
+
+	if (hist.size() != 256)
+		return -1;
+
+	switch (method) {
+	case method_mean:		return meanThreshold(hist);
+	case method_otsu:		return otsuThreshold(hist);
+	case method_triangle:	return triangleThreshold(hist);
+	}
+
+	return -1;
+}
+
+void DkThresholdEngine::updateLut() {
+
+	for (int idx = 0; idx < lut.size(); idx++) {
+		if (thrEnabled)
+			lut[idx] = (thrLower <= idx && idx <= thrUpper) ? 255 : 0;
+		else
+			lut[idx] = (uchar)idx;
+	}
+}
+
+/**
+* 8 bit images are always thresholded with their (red) gray value
+* so they have a single plane.
+**/
+int DkThresholdEngine::planeIndex(int channel) const {
+
+	return src.depth() == 8 ? channel_gray : channel;
+}
+
+/**
+* Extracts the channel plane and its histogram.
+* Nothing is done if the plane is already cached.
+**/
+void DkThresholdEngine::computePlane(int planeIdx) {
+
+	if (src.isNull() || !stats[planeIdx].isEmpty())
+		return;
+
+	const int width = src.width();
+
+	// gray images are their own plane
+	bool isGray = src.format() == QImage::Format_Grayscale8;
+	QImage plane = isGray ? src : QImage(src.size(), QImage::Format_Grayscale8);
+	uchar* planeBits = isGray ? 0 : plane.bits();
+	int planeBytesPerLine = plane.bytesPerLine();
+
+	// 8 bit images are thresholded with the red channel of their color table
+	uchar colorLut[256] = {0};
+	if (src.format() == QImage::Format_Indexed8) {
+
+		QVector<QRgb> colorTable = src.colorTable();
+		for (int idx = 0; idx < colorTable.size() && idx < 256; idx++)
+			colorLut[idx] = (uchar)qRed(colorTable[idx]);
+	}
+
+	// one histogram per band - merged afterwards
+	int numBands = (src.height() + bandHeight(src.size()) - 1) / bandHeight(src.size());
+	QVector<qint64> bandHists(numBands * 256, 0);
+	qint64* bandHistsPtr = bandHists.data();
+
+	processBands(src.size(), 0, [&](int bandIdx, int rowStart, int rowEnd) {
+
+		qint64* hist = bandHistsPtr + bandIdx * 256;
+
+		for (int y = rowStart; y < rowEnd; y++) {
+
+			const uchar* srcRow = src.constScanLine(y);
+
+			if (isGray) {
+				histogramRow(srcRow, width, hist);
+				continue;
+			}
+
+			uchar* dst = planeBits + y * planeBytesPerLine;
+
+			switch (src.format()) {
+			case QImage::Format_Indexed8:
+				extractRowIndexed8(srcRow, dst, width, colorLut);
+				break;
+			case QImage::Format_RGB888:
+				extractRow24(srcRow, dst, width, planeIdx);
+				break;
+			default:
+				extractRow32(reinterpret_cast<const QRgb*>(srcRow), dst, width, planeIdx);
+			}
+
+			histogramRow(dst, width, hist);
+		}
+	});
+
+	QVector<qint64> hist(256, 0);
+	for (int bIdx = 0; bIdx < numBands; bIdx++) {
+		for (int idx = 0; idx < 256; idx++)
+			hist[idx] += bandHists[bIdx * 256 + idx];
+	}
+
+	stats[planeIdx].plane = plane;
+	stats[planeIdx].histogram = hist;
+}
+
+/**
+* Computes the integral and squared integral images of the plane.
+* Both are stored as unsigned 32 bit values: the sums wrap around, but the
+* differences of four corners are still exact as long as the window sum fits
+* into 32 bit (see windowSize()). This halves the memory compared to 64 bit.
+**/
+void DkThresholdEngine::computeIntegrals(int planeIdx) {
+
+	DkThresholdStats& cStats = stats[planeIdx];
+
+	if (cStats.isEmpty() || cStats.hasIntegrals())
+		return;
+
+	const int width = src.width();
+	const int height = src.height();
+	const int stride = width + 1;
+	const QImage plane = cStats.plane;
+
+	QVector<quint32> integral((height + 1) * stride, 0);
+	QVector<quint32> integralSq((height + 1) * stride, 0);
+	quint32* iPtr = integral.data();
+	quint32* sqPtr = integralSq.data();
+
+	// prefix sums of all rows
+	processBands(src.size(), 0, [&](int, int rowStart, int rowEnd) {
+
+		for (int y = rowStart; y < rowEnd; y++) {
+
+			const uchar* p = plane.constScanLine(y);
+			quint32* iRow = iPtr + (y + 1) * stride;
+			quint32* sqRow = sqPtr + (y + 1) * stride;
+			quint32 sum = 0;
+			quint32 sumSq = 0;
+
+			for (int x = 0; x < width; x++) {
+				sum += p[x];
+				sumSq += p[x] * p[x];
+				iRow[x + 1] = sum;
+				sqRow[x + 1] = sumSq;
+			}
+		}
+	});
+
+	// accumulate the rows - column stripes are independent
+	int numStripes = qMax(QThread::idealThreadCount(), 1) * 4;
+	int stripeWidth = qMax((stride + numStripes - 1) / numStripes, 64);
+
+	QVector<int> stripes;
+	for (int x = 0; x < stride; x += stripeWidth)
+		stripes << x;
+
+	QtConcurrent::blockingMap(stripes, [&](const int& xStart) {
+
+		int xEnd = qMin(xStart + stripeWidth, stride);
+
+		for (int y = 2; y <= height; y++) {
+
+			quint32* iRow = iPtr + y * stride;
+			quint32* sqRow = sqPtr + y * stride;
+
+			for (int x = xStart; x < xEnd; x++) {
+				iRow[x] += iRow[x - stride];
+				sqRow[x] += sqRow[x - stride];
+			}
+		}
+	});
+
+	cStats.integral = integral;
+	cStats.integralSq = integralSq;
+}
+
+/**
+* Returns the window size of the adaptive methods.
+* It scales with the image but is limited to 255 so that
+* the squared window sums (255 * 255 * 255^2) fit into 32 bit.
+**/
+int DkThresholdEngine::windowSize() const {
+
+	int ws = qMin(src.width(), src.height()) / 40;
+
+	return qBound(15, ws, 255) | 1;
+}
+
+/**
+* Thresholds the cached plane of the current channel.
+* 8 bit images result in RGB32 images, all other formats keep
+* their format (exotic formats are converted to (A)RGB32 first).
+* @param abort if it is set while processing, the remaining bands are skipped
+* @return the thresholded image or a null image if it was aborted
+**/
+QImage DkThresholdEngine::threshold(const QAtomicInt* abort) const {
+
+	const DkThresholdStats& cStats = stats[planeIndex(thrChannel)];
+	QImage dst = createTarget();
+
+	if (dst.isNull() || cStats.isEmpty())
+		return QImage();
+
+	// get the buffer once - QImage::scanLine() would detach from the worker threads
+	uchar* dstBits = dst.bits();
+	int dstBytesPerLine = dst.bytesPerLine();
+	bool adaptive = thrEnabled && isAdaptive(thrAdaptive) && cStats.hasIntegrals();
+
+	processBands(src.size(), abort, [&](int, int rowStart, int rowEnd) {
+
+		if (adaptive)
+			thresholdRowsAdaptive(cStats, dstBits, dstBytesPerLine, rowStart, rowEnd);
+		else
+			thresholdRows(cStats, dstBits, dstBytesPerLine, rowStart, rowEnd);
+	});
+
+	if (abort && abort->load())
+		return QImage();
+
+	return dst;
+}
+
+/**
+* Converts the image to a format that is supported by the scanline kernels.
+* @param img the input image
+* @return img if its format is supported - a converted copy otherwise
+**/
+QImage DkThresholdEngine::prepareSource(const QImage& img) const {
+
+	switch (img.format()) {
+	case QImage::Format_Indexed8:
+	case QImage::Format_Grayscale8:
+	case QImage::Format_RGB888:
+	case QImage::Format_RGB32:
+	case QImage::Format_ARGB32:
+		return img;
+	default:
+		break;
+	}
+
+	if (img.isNull())
+		return img;
+
+	if (img.depth() == 8)
+		return img.convertToFormat(QImage::Format_Grayscale8);
+
+	return img.convertToFormat(img.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+}
+
+QImage DkThresholdEngine::createTarget() const {
+
+	if (src.isNull())
+		return QImage();
+
+	QImage dst(src.size(), src.depth() == 8 ? QImage::Format_RGB32 : src.format());
+	dst.setDotsPerMeterX(src.dotsPerMeterX());
+	dst.setDotsPerMeterY(src.dotsPerMeterY());
+
+	return dst;
+}
+
+/**
+* Thresholds the rows [rowStart rowEnd) of the plane.
+* The target buffer must have been created with createTarget().
+* No QImage is modified here, so disjoint row ranges can be processed concurrently.
+**/
+void DkThresholdEngine::thresholdRows(const DkThresholdStats& cStats, uchar* dstBits, int dstBytesPerLine, int rowStart, int rowEnd) const {
+
+	const QImage& plane = cStats.plane;
+	const int width = src.width();
+	const uchar* cLut = lut.constData();
+
+	if (src.format() == QImage::Format_RGB888) {
+
+		for (int y = rowStart; y < rowEnd; y++)
+			thresholdRow24(plane.constScanLine(y), dstBits + y * dstBytesPerLine, width, cLut);
+		return;
+	}
+
+	QRgb lut32[256];
+	for (int idx = 0; idx < 256; idx++)
+		lut32[idx] = grayPixel(cLut[idx], 0xff000000);
+
+	for (int y = rowStart; y < rowEnd; y++) {
+
+		QRgb* dst = reinterpret_cast<QRgb*>(dstBits + y * dstBytesPerLine);
+		thresholdRowGray8(plane.constScanLine(y), dst, width, lut32, thrLower, thrUpper, thrEnabled);
+
+		if (src.format() == QImage::Format_ARGB32)
+			alphaRow(reinterpret_cast<const QRgb*>(src.constScanLine(y)), dst, width);
+	}
+}
+
+/**
+* Thresholds the rows [rowStart rowEnd) with Niblack's or Sauvola's method.
+* The local mean and standard deviation are looked up in the integral images.
+**/
+void DkThresholdEngine::thresholdRowsAdaptive(const DkThresholdStats& cStats, uchar* dstBits, int dstBytesPerLine, int rowStart, int rowEnd) const {
+
+	const int width = src.width();
+	const int height = src.height();
+	const int stride = width + 1;
+	const int r = windowSize() / 2;
+	const quint32* integral = cStats.integral.constData();
+	const quint32* integralSq = cStats.integralSq.constData();
+
+	bool sauvola = thrAdaptive == method_sauvola;
+	const double k = sauvola ? 0.34 : -0.2;
+	const double R = 128.0;		// dynamic range of the standard deviation
+
+	// the binary row is written with the identity mapping
+	uchar identity[256];
+	QRgb identity32[256];
+	for (int idx = 0; idx < 256; idx++) {
+		identity[idx] = (uchar)idx;
+		identity32[idx] = grayPixel((uchar)idx, 0xff000000);
+	}
+
+	QVector<uchar> binRow(width);
+	uchar* bin = binRow.data();
+
+	for (int y = rowStart; y < rowEnd; y++) {
+
+		int y0 = qMax(y - r, 0);
+		int y1 = qMin(y + r + 1, height);
+
+		const quint32* i0 = integral + y0 * stride;
+		const quint32* i1 = integral + y1 * stride;
+		const quint32* sq0 = integralSq + y0 * stride;
+		const quint32* sq1 = integralSq + y1 * stride;
+		const uchar* p = cStats.plane.constScanLine(y);
+
+		for (int x = 0; x < width; x++) {
+
+			int x0 = qMax(x - r, 0);
+			int x1 = qMin(x + r + 1, width);
+			double n = (double)(x1 - x0) * (y1 - y0);
+
+			// unsigned wrap around cancels out
+			quint32 sum = i1[x1] - i1[x0] - i0[x1] + i0[x0];
+			quint32 sumSq = sq1[x1] - sq1[x0] - sq0[x1] + sq0[x0];
+
+			double mean = sum / n;
+			double var = sumSq / n - mean * mean;
+			double sd = var > 0 ? std::sqrt(var) : 0.0;
+			double thr = sauvola ? mean * (1.0 + k * (sd / R - 1.0)) : mean + k * sd;
+
+			bin[x] = p[x] > thr ? 255 : 0;
+		}
+
+		uchar* dst = dstBits + y * dstBytesPerLine;
+
+		if (src.format() == QImage::Format_RGB888) {
+			thresholdRow24(bin, dst, width, identity);
+		}
+		else {
+			thresholdRowGray8(bin, reinterpret_cast<QRgb*>(dst), width, identity32, 0, 255, false);
+
+			if (src.format() == QImage::Format_ARGB32)
+				alphaRow(reinterpret_cast<const QRgb*>(src.constScanLine(y)), reinterpret_cast<QRgb*>(dst), width);
+		}
+	}
+}
+
+};
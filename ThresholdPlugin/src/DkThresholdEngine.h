@@ -0,0 +1,134 @@
+/*******************************************************************************************************
+ DkThresholdEngine.h
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include <QImage>
+#include <QVector>
+#include <QAtomicInt>
+
+namespace nmp {
+
+/**
+*	Cached statistics of a single channel plane.
+*	The integral images are only computed once an adaptive method needs them.
+**/
+class DkThresholdStats {
+
+public:
+	bool isEmpty() const { return plane.isNull(); }
+	bool hasIntegrals() const { return !integral.isEmpty(); }
+
+	QImage plane;					// 8 bit channel plane
+	QVector<qint64> histogram;		// 256 bins
+	QVector<quint32> integral;		// (width+1) x (height+1), sums are modulo 2^32
+	QVector<quint32> integralSq;	// the same for squared values
+};
+
+/**
+*	Scanline based threshold kernel.
+*	The selected channel of the image is extracted once into an 8 bit
+*	plane together with its 256 bin histogram. Threshold changes only
+*	map this cached plane through a 256 entry lookup table (or compare
+*	it directly in the SSE2/AVX2 paths) and write straight into the
+*	output buffer. Large images are split into row bands which are
+*	processed concurrently.
+*	Global auto thresholds (mean, Otsu, Triangle) are computed from the
+*	histogram, the adaptive methods (Niblack, Sauvola) threshold each
+*	pixel with the local mean and standard deviation which are looked
+*	up in the cached integral images.
+**/
+class DkThresholdEngine {
+
+public:
+
+	enum {
+		channel_gray = 0,
+		channel_red,
+		channel_green,
+		channel_blue,
+
+		channel_end,
+	};
+
+	enum {
+		method_mean = 0,
+		method_otsu,
+		method_triangle,
+		method_niblack,
+		method_sauvola,
+
+		method_end,
+	};
+
+	DkThresholdEngine();
+
+	static bool isAdaptive(int method);
+
+	void setImage(const QImage& img);
+	QImage image() const;
+
+	void setChannel(int channel);
+	void setRange(int lower, int upper);
+	void setEnabled(bool enabled);
+
+	int channel() const;
+	int lower() const;
+	int upper() const;
+	bool isEnabled() const;
+
+	void setAdaptiveMethod(int method);
+	int adaptiveMethod() const;
+
+	QVector<qint64> histogram() const;
+	int globalThreshold(int method) const;
+	QImage threshold(const QAtomicInt* abort = 0) const;
+
+protected:
+	void updateLut();
+	void computePlane(int planeIdx);
+	void computeIntegrals(int planeIdx);
+	int planeIndex(int channel) const;
+	int windowSize() const;
+
+	QImage prepareSource(const QImage& img) const;
+	QImage createTarget() const;
+	void thresholdRows(const DkThresholdStats& cStats, uchar* dstBits, int dstBytesPerLine, int rowStart, int rowEnd) const;
+	void thresholdRowsAdaptive(const DkThresholdStats& cStats, uchar* dstBits, int dstBytesPerLine, int rowStart, int rowEnd) const;
+
+	int thrChannel;
+	int thrLower;
+	int thrUpper;
+	bool thrEnabled;
+	int thrAdaptive;
+	QVector<uchar> lut;
+
+	QImage src;
+	QVector<DkThresholdStats> stats;	// cached per channel
+};
+
+};
@@ -28,6 +28,8 @@
 #include "DkThresholdPlugin.h"
 
 #include <QMouseEvent>
+#include <QPainter>
+#include <QtConcurrentRun>
 
 namespace nmp {
 
@@ -83,8 +85,12 @@ QSharedPointer<nmc::DkImageContainer> DkThresholdPlugin::runPlugin(const QString
 		DkThresholdViewPort* thresholdViewport = dynamic_cast<DkThresholdViewPort*>(viewport);
 
 		QImage retImg;
-		if (!thresholdViewport->isCanceled()) 
+		if (!thresholdViewport->isCanceled()) {
 			imgC->setImage(thresholdViewport->getThresholdedImage(true), tr("Thresholded"));
+
+			// the batch plugin uses the last applied values
+			thresholdViewport->saveSettings(nmc::DkSettingsManager::instance().qSettings());
+		}
 		else {
 			if (parent()) {
 				nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
@@ -126,6 +132,8 @@ DkThresholdViewPort::DkThresholdViewPort(QWidget* parent, Qt::WindowFlags flags)
 
 DkThresholdViewPort::~DkThresholdViewPort() {
 
+	cancelThreshold();
+
 	// acitive deletion since the MainWindow takes ownership...
 	// if we have issues with this, we could disconnect all signals between viewport and toolbar too
 	// however, then we have lot's of toolbars in memory if the user opens the plugin again and again
@@ -141,12 +149,23 @@ void DkThresholdViewPort::init() {
 	cancelTriggered = false;
 	defaultCursor = Qt::ArrowCursor;
 	setCursor(defaultCursor);
-	thrChannel = channel_gray;
-	thrEnabled = true;
-	thrValue = 128;
-	thrValueUpper = thrValue;	
+	thrEngine.setChannel(DkThresholdEngine::channel_gray);
+	thrEngine.setEnabled(true);
+	thrEngine.setRange(128, 128);
 	origImg = QImage();
 	origImgSet = false;
+	thrMethod = DkThresholdEngine::method_mean;
+	thrAutoMethod = DkThresholdEngine::method_end;
+	thrPending = false;
+	proxyLevel = 0;
+
+	connect(&thrWatcher, SIGNAL(finished()), this, SLOT(thresholdFinished()));
+
+	// the full resolution pass starts if the values did not change for a while
+	idleTimer = new QTimer(this);
+	idleTimer->setSingleShot(true);
+	idleTimer->setInterval(400);
+	connect(idleTimer, SIGNAL(timeout()), this, SLOT(thresholdFullResolution()));
 
 	thresholdToolbar = new DkThresholdToolBar(tr("Threshold Toolbar"), this);
 
@@ -154,6 +173,7 @@ void DkThresholdViewPort::init() {
 	connect(thresholdToolbar, SIGNAL(thrValSignal(int)), this, SLOT(setThrValue(int)));
 	connect(thresholdToolbar, SIGNAL(thrValUpperSignal(int)), this, SLOT(setThrValueUpper(int)));
 	connect(thresholdToolbar, SIGNAL(calculateAutoThresholdSignal()), this, SLOT(calculateAutoThreshold()));
+	connect(thresholdToolbar, SIGNAL(thrMethodSignal(int)), this, SLOT(setThrMethod(int)));
 	connect(thresholdToolbar, SIGNAL(thrEnabledSignal(bool)), this, SLOT(setThrEnabled(bool)));
 	connect(thresholdToolbar, SIGNAL(panSignal(bool)), this, SLOT(setPanning(bool)));
 	connect(thresholdToolbar, SIGNAL(cancelSignal()), this, SLOT(discardChangesAndClose()));
@@ -200,6 +220,18 @@ void DkThresholdViewPort::mouseReleaseEvent(QMouseEvent *event) {
 
 void DkThresholdViewPort::paintEvent(QPaintEvent *event) {
 
+	// the proxy is drawn until the full resolution pass (which is always scheduled while a proxy is shown) is done
+	// if the zoom changed, the proxy is scaled - the matching mip level is picked with the next value change
+	if (!proxyImg.isNull()) {
+
+		QPainter painter(this);
+
+		if (mWorldMatrix)
+			painter.setWorldTransform((*mImgMatrix) * (*mWorldMatrix));
+
+		painter.drawImage(QRectF(QPointF(), origImg.size()), proxyImg);
+	}
+
 	DkPluginViewPort::paintEvent(event);
 }
 
@@ -208,178 +240,252 @@ QImage DkThresholdViewPort::getOriginalImage() {
 	return origImg;
 }
 
-QImage DkThresholdViewPort::getThresholdedImage(bool thrEnabled) {
+/**
+* Stores the current values for the threshold batch plugin.
+* Auto thresholds are stored as method so that they adapt to each image.
+**/
+void DkThresholdViewPort::saveSettings(QSettings& settings) const {
 
+	settings.beginGroup("Threshold Plugin");
+	settings.setValue("Channel", thrEngine.channel());
+	settings.setValue("Lower", thrEngine.lower());
+	settings.setValue("Upper", thrEngine.upper());
+	settings.setValue("Method", thrAutoMethod);
+	settings.endGroup();
+}
+
+void DkThresholdViewPort::grabOriginalImage() {
 
 	if(parent() && !origImgSet) {
 		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
 		if (viewport) {
 			origImg = viewport->getImage();
 			origImgSet = true;
+
+			// extracts the channel plane and its histogram once
+			thrEngine.setImage(origImg);
 		}
 	}
+}
 
-	QImage thrImage = QImage(origImg);
+QImage DkThresholdViewPort::getThresholdedImage(bool thrEnabled) {
 
-	switch (thrImage.depth()) {
-		case 8:
-			thrImage = QImage(origImg.size(), QImage::Format_RGB32);
+	grabOriginalImage();
 
-			for (int y = 0; y < thrImage.height(); y++) {
-				for (int x = 0; x < thrImage.width(); x++) {
-					int gray =  (thrEnabled) ? ((thrValue <= qRed(origImg.pixel(x, y)) && qRed(origImg.pixel(x, y)) <= thrValueUpper) ? 255 : 0)  :  qRed(origImg.pixel(x, y));
-					thrImage.setPixel(x, y, qRgb(gray, gray, gray));
-				}
-			}
-			break;
-		case 24:
-			for (int y = 0; y < thrImage.height(); y++) {
-				for (int x = 0; x < thrImage.width(); x++) {
-					int pixel = thrImage.pixel(x, y);
-					int gray = 0;
-					switch (thrChannel) {
-						case channel_gray:
-							gray =  (thrEnabled) ? ((thrValue <= qGray(pixel) && qGray(pixel) <= thrValueUpper) ? 255 : 0) : qGray(pixel);
-							break;
-						case channel_red:
-							gray =  (thrEnabled) ? ((thrValue <= qRed(pixel) && qRed(pixel) <= thrValueUpper) ? 255 : 0) : qRed(pixel);
-							break;
-						case channel_blue:
-							gray =  (thrEnabled) ? ((thrValue <= qBlue(pixel) && qBlue(pixel) <= thrValueUpper) ? 255 : 0) : qBlue(pixel);
-							break;
-						case channel_green:
-							gray =  (thrEnabled) ? ((thrValue <= qGreen(pixel) && qGreen(pixel) <= thrValueUpper) ? 255 : 0) : qGreen(pixel);
-							break;
-					}
-					thrImage.setPixel(x, y, qRgb(gray, gray, gray));
-				}
-			}
-			break;
-		case 32:
-			for (int y = 0; y < thrImage.height(); y++) {
-				for (int x = 0; x < thrImage.width(); x++) {
-					int pixel = thrImage.pixel(x, y);
-					int gray = 0;
-					switch (thrChannel) {
-						case channel_gray:
-							gray =  (thrEnabled) ? ((thrValue <= qGray(pixel) && qGray(pixel) <= thrValueUpper) ? 255 : 0) : qGray(pixel);
-							break;
-						case channel_red:
-							gray =  (thrEnabled) ? ((thrValue <= qRed(pixel) && qRed(pixel) <= thrValueUpper) ? 255 : 0) : qRed(pixel);
-							break;
-						case channel_blue:
-							gray =  (thrEnabled) ? ((thrValue <= qBlue(pixel) && qBlue(pixel) <= thrValueUpper) ? 255 : 0) : qBlue(pixel);
-							break;
-						case channel_green:
-							gray =  (thrEnabled) ? ((thrValue <= qGreen(pixel) && qGreen(pixel) <= thrValueUpper) ? 255 : 0) : qGreen(pixel);
-							break;
-					}
-					int alpha = qAlpha(pixel);
-					thrImage.setPixel(x, y, qRgba(gray, gray, gray, alpha));
-				}
-			}
-			break;
+	DkThresholdEngine engine = thrEngine;
+	engine.setEnabled(thrEnabled);
+
+	return engine.threshold();
+}
+
+/**
+* Returns the mip level whose resolution matches the current zoom.
+* Level 0 is the original image, each level halves its size.
+**/
+int DkThresholdViewPort::proxyLevelForZoom() const {
+
+	double scale = 1.0;
+	if (mImgMatrix)		scale *= mImgMatrix->m11();
+	if (mWorldMatrix)	scale *= mWorldMatrix->m11();
+
+	int level = 0;
+	int minSide = qMin(origImg.width(), origImg.height());
+
+	while (scale > 0.0 && scale <= 0.5 && (minSide >> (level + 1)) > 0) {
+		scale *= 2.0;
+		level++;
 	}
 
-	if (origImg.depth() == 8) {
+	return level;
+}
 
-		QImage outImage = QImage(origImg.size(), QImage::Format_RGB32);
+QImage DkThresholdViewPort::proxyImage(int level) {
 
-		QPainter painter(&outImage);
+	if (proxyPyramid.isEmpty())
+		proxyPyramid << origImg;
 
-		painter.drawImage(thrImage.rect(), thrImage);
+	while (proxyPyramid.size() <= level) {
+		const QImage& img = proxyPyramid.last();
+		proxyPyramid << img.scaled(qMax(img.width() / 2, 1), qMax(img.height() / 2, 1), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	}
 
-		painter.end();
+	return proxyPyramid[level];
+}
 
-		return outImage;
+/**
+* Thresholds the mip level that matches the current zoom.
+* @return false if the image is shown at full resolution
+**/
+bool DkThresholdViewPort::thresholdProxy() {
+
+	int level = proxyLevelForZoom();
+
+	if (level == 0)
+		return false;
+
+	if (level != proxyLevel) {
+		proxyEngine.setImage(proxyImage(level));
+		proxyLevel = level;
 	}
 
-	QImage outImage = QImage(origImg);
-	QPainter painter(&outImage);
+	proxyEngine.setChannel(thrEngine.channel());
+	proxyEngine.setRange(thrEngine.lower(), thrEngine.upper());
+	proxyEngine.setEnabled(thrEngine.isEnabled());
+	proxyEngine.setAdaptiveMethod(thrEngine.adaptiveMethod());
 
-	painter.drawImage(thrImage.rect(), thrImage);
+	proxyImg = proxyEngine.threshold();
 
-	painter.end();
-			
-	return outImage;
+	return true;
 }
 
-void DkThresholdViewPort::setThrValue(int val) {
+/**
+* Updates the preview after the values changed.
+* If the image is zoomed out, a proxy with display resolution is thresholded
+* right away and the full resolution pass is deferred until the values
+* did not change for a while.
+**/
+void DkThresholdViewPort::updateThresholdedImage() {
 
-	this->thrValue = val;
-	if (parent()) {
-		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
-		if (viewport) viewport->setImage(getThresholdedImage(this->thrEnabled));
+	grabOriginalImage();
+
+	if (thresholdProxy()) {
+
+		// a running pass is outdated
+		thrPending = false;
+		if (thrWatcher.isRunning())
+			thrAbort->store(1);
+
+		idleTimer->start();
+		update();
+		return;
 	}
-	this->repaint();
+
+	thresholdFullResolution();
 }
 
-void DkThresholdViewPort::setThrValueUpper(int val) {
+/**
+* Thresholds the original image in the background.
+* If a pass is still running, it is aborted and restarted with
+* the current values as soon as it returns.
+**/
+void DkThresholdViewPort::thresholdFullResolution() {
 
-	this->thrValueUpper = val;
-	if (parent()) {
-		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
-		if (viewport) viewport->setImage(getThresholdedImage(this->thrEnabled));
+	if (thrWatcher.isRunning()) {
+		thrAbort->store(1);
+		thrPending = true;
+		return;
 	}
-	this->repaint();
+
+	thrPending = false;
+	thrAbort = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+
+	// the copy shares the cached planes
+	DkThresholdEngine engine = thrEngine;
+	QSharedPointer<QAtomicInt> abort = thrAbort;
+
+	thrWatcher.setFuture(QtConcurrent::run([engine, abort]() {
+		return engine.threshold(abort.data());
+	}));
 }
 
-void DkThresholdViewPort::setThrEnabled(bool enabled) {
+void DkThresholdViewPort::thresholdFinished() {
+
+	// the values changed in the meantime
+	if (thrPending) {
+		thresholdFullResolution();
+		return;
+	}
+
+	QImage thrImg = thrWatcher.result();
+
+	// aborted - or outdated by a newer proxy
+	if (thrImg.isNull() || thrAbort->load())
+		return;
 
-	this->thrEnabled = enabled;
 	if (parent()) {
 		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
-		if (viewport) viewport->setImage(getThresholdedImage(this->thrEnabled));
+		if (viewport) viewport->setImage(thrImg);
 	}
-	this->repaint();
+
+	proxyImg = QImage();
+	this->update();
+}
+
+void DkThresholdViewPort::cancelThreshold() {
+
+	thrPending = false;
+	idleTimer->stop();
+	proxyImg = QImage();
+
+	if (thrAbort)
+		thrAbort->store(1);
+
+	thrWatcher.waitForFinished();
+}
+
+void DkThresholdViewPort::setThrValue(int val) {
+
+	// manual changes switch back to the global threshold
+	thrEngine.setAdaptiveMethod(DkThresholdEngine::method_end);
+	thrAutoMethod = DkThresholdEngine::method_end;
+	thrEngine.setRange(val, thrEngine.upper());
+	updateThresholdedImage();
+}
+
+void DkThresholdViewPort::setThrValueUpper(int val) {
+
+	thrEngine.setAdaptiveMethod(DkThresholdEngine::method_end);
+	thrAutoMethod = DkThresholdEngine::method_end;
+	thrEngine.setRange(thrEngine.lower(), val);
+	updateThresholdedImage();
+}
+
+void DkThresholdViewPort::setThrEnabled(bool enabled) {
+
+	thrEngine.setEnabled(enabled);
+	updateThresholdedImage();
 }
 
 void DkThresholdViewPort::setThrChannel(int val) {
 
-	this->thrChannel = val;
-	if (parent()) {
-		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
-		if (viewport) viewport->setImage(getThresholdedImage(this->thrEnabled));
-	}
-	this->repaint();
+	thrEngine.setChannel(val);
+	updateThresholdedImage();
+}
+
+void DkThresholdViewPort::setThrMethod(int val) {
+
+	thrMethod = val;
 }
 
 void DkThresholdViewPort::calculateAutoThreshold() {
 
-	double sumPixel = 0;
+	grabOriginalImage();
 
-	if (origImg.depth() == 8) {
-		for (int y = 0; y < origImg.height(); y++) {
-			for (int x = 0; x < origImg.width(); x++) {
-				sumPixel += qRed(origImg.pixel(x, y));
-			}
-		}
-	}
-	else if(origImg.depth() == 24 || origImg.depth() == 32) {
-		for (int y = 0; y < origImg.height(); y++) {
-			for (int x = 0; x < origImg.width(); x++) {
-				int pixel = origImg.pixel(x, y);
-				switch (thrChannel) {
-					case channel_gray:
-						sumPixel += qGray(origImg.pixel(x, y));
-						break;
-					case channel_red:
-						sumPixel += qRed(origImg.pixel(x, y));
-						break;
-					case channel_blue:
-						sumPixel += qBlue(origImg.pixel(x, y));
-						break;
-					case channel_green:
-						sumPixel += qGreen(origImg.pixel(x, y));
-						break;
-				}
-			}
-		}
+	// local thresholds - the integral images are computed once per channel
+	if (DkThresholdEngine::isAdaptive(thrMethod)) {
+		thrEngine.setAdaptiveMethod(thrMethod);
+		thrAutoMethod = thrMethod;
+		updateThresholdedImage();
+		return;
 	}
 
-	sumPixel /= (origImg.height() * origImg.width());
+	// global thresholds are computed from the cached histogram
+	int thr = thrEngine.globalThreshold(thrMethod);
+
+	if (thr < 0)
+		return;
+
+	bool wasAdaptive = DkThresholdEngine::isAdaptive(thrEngine.adaptiveMethod());
+	thrEngine.setAdaptiveMethod(DkThresholdEngine::method_end);
+
+	// the toolbar does not signal if the value is unchanged
+	if (wasAdaptive && thr == thrEngine.lower())
+		updateThresholdedImage();
 
-	thresholdToolbar->setThrValue(qRound(sumPixel));
+	thresholdToolbar->setThrValue(thr);
+
+	// after setThrValue() which resets it
+	thrAutoMethod = thrMethod;
 }
 
 void DkThresholdViewPort::setPanning(bool checked) {
@@ -392,12 +498,14 @@ void DkThresholdViewPort::setPanning(bool checked) {
 
 void DkThresholdViewPort::applyChangesAndClose() {
 
+	cancelThreshold();
 	cancelTriggered = false;
 	emit closePlugin();
 }
 
 void DkThresholdViewPort::discardChangesAndClose() {
 
+	cancelThreshold();
 	cancelTriggered = true;
 	if(parent() && origImgSet) {
 		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
@@ -523,6 +631,20 @@ void DkThresholdToolBar::createLayout() {
 	
 	connect(thrValBox, SIGNAL(valueChanged(int)), this, SLOT(setBoxMinimumValue(int)));
 
+	//auto threshold method
+	QStringList thrMethods;
+	thrMethods.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "Mean"));
+	thrMethods.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "Otsu"));
+	thrMethods.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "Triangle"));
+	thrMethods.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "Niblack"));
+	thrMethods.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "Sauvola"));
+
+	thrMethodBox = new QComboBox(this);
+	thrMethodBox->addItems(thrMethods);
+	thrMethodBox->setObjectName("thrMethodBox");
+	thrMethodBox->setToolTip(tr("Automatic threshold method"));
+	thrMethodBox->setStatusTip(thrMethodBox->toolTip());
+
 	//auto threshold
 	autoThrButton = new QPushButton(tr("Auto"), this);
 	autoThrButton->setObjectName("autoThrButton");
@@ -545,6 +667,7 @@ void DkThresholdToolBar::createLayout() {
 	addWidget(thrValBox);
 	addWidget(thrValSlider);
 	addWidget(thrValUpperBox);
+	addWidget(thrMethodBox);
 	addWidget(autoThrButton);
 	addWidget(thrEnableBox);
 }
@@ -591,6 +714,11 @@ void DkThresholdToolBar::on_thrChannelBox_currentIndexChanged(int val) {
 	emit thrChannelSignal(val);
 }
 
+void DkThresholdToolBar::on_thrMethodBox_currentIndexChanged(int val) {
+
+	emit thrMethodSignal(val);
+}
+
 void DkThresholdToolBar::on_thrValUpperBox_valueChanged(int val) {
 
 	emit thrValUpperSignal(val);
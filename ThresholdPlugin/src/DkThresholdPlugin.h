@@ -45,6 +45,11 @@
 #include <QSlider>
 #include <QPushButton>
 #include <QMouseEvent>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QSettings>
 
 #include "DkPluginInterface.h"
 #include "DkSettings.h"
@@ -52,11 +57,17 @@
 #include "DkBaseViewPort.h"
 #include "DkImageStorage.h"
 
+#include "DkThresholdEngine.h"
+
 namespace nmp {
 
 class DkThresholdViewPort;
 class DkThresholdToolBar;
 
+/**
+*	Thresholds interactively. The applied values are stored for
+*	the threshold batch plugin (DkThresholdBatchPlugin).
+**/
 class DkThresholdPlugin : public QObject, nmc::DkViewPortInterface {
     Q_OBJECT
     Q_INTERFACES(nmc::DkViewPortInterface)
@@ -91,6 +102,7 @@ public:
 	bool isCanceled();
 	QImage getThresholdedImage(bool thrEnabled);
 	QImage getOriginalImage();
+	void saveSettings(QSettings& settings) const;
 
 public slots:
 	void setPanning(bool checked);
@@ -102,34 +114,45 @@ public slots:
 	void calculateAutoThreshold();
 	void setThrChannel(int val);
 	void setThrEnabled(bool enabled);
+	void setThrMethod(int val);
 
-protected:
-
-	enum {
-		channel_gray = 0,
-		channel_red,
-		channel_green,
-		channel_blue,
-
-		channel_end,
-	};
+protected slots:
+	void thresholdFinished();
+	void thresholdFullResolution();
 
+protected:
 	void mouseMoveEvent(QMouseEvent *event);
 	void mousePressEvent(QMouseEvent *event);
 	void mouseReleaseEvent(QMouseEvent*event);
 	void paintEvent(QPaintEvent *event);
 	virtual void init();
+	void grabOriginalImage();
+	void updateThresholdedImage();
+	void cancelThreshold();
+	int proxyLevelForZoom() const;
+	QImage proxyImage(int level);
+	bool thresholdProxy();
 
 	bool cancelTriggered;
 	bool panning;
 	DkThresholdToolBar* thresholdToolbar;
 	QCursor defaultCursor;
-	int thrChannel;
-	int thrValue;
-	int thrValueUpper;
-	bool thrEnabled;
+	DkThresholdEngine thrEngine;
 	QImage origImg;
 	bool origImgSet;
+	int thrMethod;
+	int thrAutoMethod;	// the auto method that produced the current values (or method_end)
+
+	QFutureWatcher<QImage> thrWatcher;
+	QSharedPointer<QAtomicInt> thrAbort;
+	bool thrPending;
+
+	// display resolution preview
+	DkThresholdEngine proxyEngine;
+	QVector<QImage> proxyPyramid;	// mip levels of the original image, built on demand
+	QImage proxyImg;				// thresholded proxy - shown until the full resolution pass is done
+	int proxyLevel;
+	QTimer* idleTimer;
 };
 
 
@@ -161,6 +184,7 @@ public slots:
 	void on_thrValBox_valueChanged(int val);
 	void on_thrValUpperBox_valueChanged(int val);
 	void on_thrChannelBox_currentIndexChanged(int val);
+	void on_thrMethodBox_currentIndexChanged(int val);
 	void on_thrEnableBox_stateChanged(int val);
 	void on_autoThrButton_clicked();
 	virtual void setVisible(bool visible);
@@ -173,6 +197,7 @@ signals:
 	void thrValUpperSignal(int val);
 	void calculateAutoThresholdSignal();
 	void thrChannelSignal(int val);
+	void thrMethodSignal(int val);
 	void thrEnabledSignal(bool enabled);
 	void panSignal(bool checked);
 
@@ -186,6 +211,7 @@ protected:
 	QComboBox* thrChannelBox;
 	QCheckBox* thrEnableBox;
 	QListWidget* thrChannelBoxContents;
+	QComboBox* thrMethodBox;
 	QPushButton* autoThrButton;
 
 	QAction* panAction;
@@ -0,0 +1,61 @@
+/*******************************************************************************************************
+ DkThresholdUtils.h
+ Created on:	17.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QSize>
+#include <QThread>
+#pragma warning(pop)		// no warnings from includes - end
+
+// SSE2 is part of every x64 target, AVX2 needs to be enabled by the compiler (-mavx2 or /arch:AVX2)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DK_THR_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef __AVX2__
+#define DK_THR_AVX2
+#include <immintrin.h>
+#endif
+
+namespace nmp {
+
+/**
+* Returns the number of rows per band.
+* Bands have at least 64k pixels and there are about four bands per core
+* so that threads which finish early can pick up more work.
+**/
+inline int bandHeight(const QSize& size) {
+
+	int numBands = qMax(QThread::idealThreadCount(), 1) * 4;
+	int minRows = qMax(1, 65536 / qMax(size.width(), 1));
+
+	return qMax((size.height() + numBands - 1) / numBands, minRows);
+}
+
+};